@@ -4,6 +4,12 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Largest number of sectors the dispatcher merges into a single
+   transfer. */
+#define BLOCK_MERGE_MAX 64
 
 /* A block device. */
 struct block
@@ -19,6 +25,14 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Asynchronous request queue. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct list queue;                  /* Pending requests by sector. */
+    struct condition queue_ready;       /* Signaled when QUEUE nonempty. */
+    block_sector_t head;                /* Sector after the last transfer. */
+    bool dispatching;                   /* Dispatcher thread started? */
+    uint8_t *bounce;                    /* Dispatcher's merge buffer. */
   };
 
 /* List of all block devices. */
@@ -28,6 +42,7 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void block_dispatch (void *block_);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -139,6 +154,219 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   block->write_cnt++;
 }
 
+/* Reads CNT contiguous sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Uses the driver's multi-sector transfer if it has one, so that
+   a run of sectors costs a single device command where possible.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     size_t cnt, void *buffer)
+{
+  uint8_t *p = buffer;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  if (block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->read (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+  block->read_cnt += cnt;
+}
+
+/* Writes CNT contiguous sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  const uint8_t *p = buffer;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->write (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+  block->write_cnt += cnt;
+}
+
+/* Returns true if request A starts at a lower sector than
+   request B. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* Queues request R, which must have every member but ELEM filled
+   in, for transfer to or from BLOCK and returns without waiting
+   for the transfer.  R->complete is called from BLOCK's
+   dispatcher thread once the transfer is done.  Requests are
+   issued in C-LOOK order and requests for adjacent sectors in the
+   same direction are merged into a single transfer. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  ASSERT (r->cnt > 0);
+  ASSERT (r->complete != NULL);
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->cnt - 1);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  lock_acquire (&block->queue_lock);
+  if (!block->dispatching)
+    {
+      char name[sizeof block->name + 4];
+
+      snprintf (name, sizeof name, "blk_%s", block->name);
+      if (thread_create (name, PRI_MAX, block_dispatch, block) == TID_ERROR)
+        PANIC ("Failed to start dispatcher for block device %s",
+               block->name);
+      block->dispatching = true;
+    }
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  cond_signal (&block->queue_ready, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Removes the next request to issue from BLOCK's queue, which must
+   be nonempty, together with every following request that can be
+   merged with it, and moves them to BATCH in sector order.  The
+   next request is the first one at or beyond the sector where the
+   previous transfer ended, wrapping around to the lowest sector
+   when there is none (C-LOOK).  Returns the total number of
+   sectors in BATCH. */
+static size_t
+take_batch (struct block *block, struct list *batch)
+{
+  struct list_elem *e;
+  struct block_request *first;
+  size_t cnt, max;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector >= block->head)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+
+  first = list_entry (e, struct block_request, elem);
+  cnt = first->cnt;
+  max = block->bounce != NULL ? BLOCK_MERGE_MAX : 0;
+  e = list_remove (e);
+  list_push_back (batch, &first->elem);
+
+  while (e != list_end (&block->queue))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->sector != first->sector + cnt || r->write != first->write
+          || cnt + r->cnt > max)
+        break;
+      cnt += r->cnt;
+      e = list_remove (e);
+      list_push_back (batch, &r->elem);
+    }
+
+  block->head = first->sector + cnt;
+  return cnt;
+}
+
+/* Transfers the CNT sectors of the requests in BATCH, which are
+   adjacent and in the same direction, through BLOCK's bounce
+   buffer in a single multi-sector transfer.  A batch of one
+   request is transferred directly to or from its own buffer. */
+static void
+do_batch (struct block *block, struct list *batch, size_t cnt)
+{
+  struct block_request *first
+    = list_entry (list_front (batch), struct block_request, elem);
+  struct list_elem *e;
+  uint8_t *p;
+
+  if (list_size (batch) == 1)
+    {
+      if (first->write)
+        block_write_multiple (block, first->sector, cnt, first->buffer);
+      else
+        block_read_multiple (block, first->sector, cnt, first->buffer);
+      return;
+    }
+
+  if (first->write)
+    {
+      for (p = block->bounce, e = list_begin (batch); e != list_end (batch);
+           e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request, elem);
+          memcpy (p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+          p += r->cnt * BLOCK_SECTOR_SIZE;
+        }
+      block_write_multiple (block, first->sector, cnt, block->bounce);
+    }
+  else
+    {
+      block_read_multiple (block, first->sector, cnt, block->bounce);
+      for (p = block->bounce, e = list_begin (batch); e != list_end (batch);
+           e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request, elem);
+          memcpy (r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+          p += r->cnt * BLOCK_SECTOR_SIZE;
+        }
+    }
+}
+
+/* Dispatcher thread for the block device BLOCK_.  Issues queued
+   requests one batch at a time and then calls their completion
+   callbacks.  If the bounce buffer cannot be allocated, requests
+   are still issued in C-LOOK order but are never merged. */
+static void
+block_dispatch (void *block_)
+{
+  struct block *block = block_;
+
+  block->bounce = malloc (BLOCK_MERGE_MAX * BLOCK_SECTOR_SIZE);
+  for (;;)
+    {
+      struct list batch;
+      size_t cnt;
+
+      list_init (&batch);
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_ready, &block->queue_lock);
+      cnt = take_batch (block, &batch);
+      lock_release (&block->queue_lock);
+
+      do_batch (block, &batch, cnt);
+      while (!list_empty (&batch))
+        {
+          struct block_request *r
+            = list_entry (list_pop_front (&batch), struct block_request, elem);
+          r->complete (r);
+        }
+    }
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -200,6 +428,12 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  lock_init (&block->queue_lock);
+  list_init (&block->queue);
+  cond_init (&block->queue_ready);
+  block->head = 0;
+  block->dispatching = false;
+  block->bounce = NULL;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -1,8 +1,10 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,9 +55,31 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* An asynchronous block request.  The submitter fills in every
+   member except ELEM and must leave the request and its buffer
+   alone until COMPLETE is called.  COMPLETE runs in the device's
+   dispatcher thread, so it must not block for long and must not
+   wait for another request on the same device. */
+struct block_request
+  {
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                         /* True to write, false to read. */
+    void (*complete) (struct block_request *); /* Completion callback. */
+    void *aux;                          /* Owned by the submitter. */
+    struct list_elem elem;              /* Element in the device queue. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
@@ -65,6 +89,14 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT contiguous sectors in as few device
+       commands as possible.  If null, the block layer falls back
+       to one read or write call per sector. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
   };
 
 struct block *block_register (const char *name, enum block_type,
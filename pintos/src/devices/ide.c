@@ -34,6 +34,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +50,13 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* Largest number of sectors a single READ/WRITE command can
+   transfer (a sector count register value of 0 means 256). */
+#define MAX_SECTORS_PER_CMD 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +65,8 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per DRQ block for READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
   };
 
 /* An ATA channel (aka controller).
@@ -85,7 +95,8 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
+static void set_multiple_mode (struct ata_disk *, const char *id);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -136,6 +147,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
         }
 
       /* Register interrupt handler. */
@@ -303,12 +315,35 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  set_multiple_mode (d, id);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D using the largest DRQ
+   block size advertised in its IDENTIFY DEVICE data ID.  Leaves
+   D->multiple at 0, meaning one DRQ block per sector, if the disk
+   does not support the feature or rejects the command. */
+static void
+set_multiple_mode (struct ata_disk *d, const char *id)
+{
+  struct channel *c = d->channel;
+  int max = *(const uint16_t *) &id[47 * 2] & 0xff;
+
+  if (max == 0)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), max);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = max;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -347,7 +382,7 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  select_sector (d, sec_no, 1);
   issue_pio_command (c, CMD_READ_SECTOR_RETRY);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
@@ -367,7 +402,7 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  select_sector (d, sec_no, 1);
   issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
   if (!wait_while_busy (d))
     PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
@@ -376,24 +411,115 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   lock_release (&c->lock);
 }
 
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Issues
+   one command per MAX_SECTORS_PER_CMD sectors, using READ
+   MULTIPLE when it is enabled so that the disk interrupts once
+   per DRQ block instead of once per sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *buffer)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      size_t done = 0;
+
+      lock_acquire (&c->lock);
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, d->multiple > 0 ? CMD_READ_MULTIPLE
+                                             : CMD_READ_SECTOR_RETRY);
+      while (done < n)
+        {
+          size_t blk = d->multiple > 0 ? (size_t) d->multiple : 1;
+          if (blk > n - done)
+            blk = n - done;
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          insw (reg_data (c), p, blk * BLOCK_SECTOR_SIZE / 2);
+          p += blk * BLOCK_SECTOR_SIZE;
+          done += blk;
+        }
+      lock_release (&c->lock);
+
+      sec_no += n;
+      cnt -= n;
+    }
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving all of the data.
+   Uses WRITE MULTIPLE when it is enabled, as ide_read_multiple().
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  const uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      size_t done = 0;
+
+      lock_acquire (&c->lock);
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                                             : CMD_WRITE_SECTOR_RETRY);
+      while (done < n)
+        {
+          size_t blk = d->multiple > 0 ? (size_t) d->multiple : 1;
+          if (blk > n - done)
+            blk = n - done;
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          outsw (reg_data (c), p, blk * BLOCK_SECTOR_SIZE / 2);
+          sema_down (&c->completion_wait);
+          p += blk * BLOCK_SECTOR_SIZE;
+          done += blk;
+        }
+      lock_release (&c->lock);
+
+      sec_no += n;
+      cnt -= n;
+    }
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, which must be between
+   1 and MAX_SECTORS_PER_CMD, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_SECTORS_PER_CMD);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
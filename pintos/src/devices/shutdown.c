@@ -21,6 +21,7 @@
 static enum shutdown_type how = SHUTDOWN_NONE;
 
 static void print_stats (void);
+static void power_off (void) NO_RETURN;
 
 /* Shuts down the machine in the way configured by
    shutdown_configure().  If the shutdown type is SHUTDOWN_NONE
@@ -87,13 +88,34 @@ shutdown_reboot (void)
 void
 shutdown_power_off (void)
 {
-  const char s[] = "Shutdown";
-  const char *p;
-
 #ifdef FILESYS
   filesys_done ();
 #endif
 
+  power_off ();
+}
+
+/* Powers down the machine as if it had lost power just after
+   the file system committed its metadata journal, without
+   shutting the file system down.  Used to test journal replay. */
+void
+shutdown_crash (void)
+{
+#ifdef FILESYS
+  filesys_crash ();
+#endif
+
+  power_off ();
+}
+
+/* Prints statistics and powers down the machine, as long as
+   we're running on Bochs or QEMU. */
+static void
+power_off (void)
+{
+  const char s[] = "Shutdown";
+  const char *p;
+
   print_stats ();
 
   printf ("Powering off...\n");
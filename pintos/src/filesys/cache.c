@@ -1,166 +1,740 @@
 #include "filesys/cache.h"
+#include <round.h>
+#include <string.h>
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
 
+struct lock cache_lock;
+struct disk_cache *cache_array;
+size_t cache_size = CACHE_DEFAULT_SIZE;
+unsigned cache_flush_interval = CACHE_FLUSH_INTERVAL;
+unsigned cache_dirty_background = CACHE_DIRTY_BACKGROUND;
+unsigned cache_dirty_max = CACHE_DIRTY_MAX;
+
+static struct hash cache_map;     // 扇区号到Cache块的哈希索引，只包含非空闲的块
+static struct list free_entries;  // 空闲Cache块组成的链表
+static struct disk_cache map_key; // 查找哈希索引时使用的键，受cache_lock保护
+static size_t clock_hand;         // 时钟替换算法的指针
+static struct condition cache_released; // 等待某个Cache块不再被固定
+static struct list dirty_list;          // 被修改过的Cache块，按照扇区号升序排列
+static size_t dirty_cnt;                // dirty_list中块的数量
+
+static void submit_io(struct disk_cache *entry, bool write);
+static void flush_dirty(size_t target);
+static int fetch_entry(block_sector_t disk_sector, bool load);
+static void bind_entry(int idx, block_sector_t disk_sector, bool load);
+
+static struct list journal_list; // 当前事务修改过的块
+static size_t journal_cnt;       // journal_list中块的数量
+static bool journaling;          // 是否记录日志
+static size_t journal_reserved;  // 进行中的日志操作预留而尚未使用的块数
+static uint32_t journal_tid = 1; // 当前事务的编号
+
+static block_sector_t ahead_queue[READ_AHEAD_QUEUE_SIZE]; // 等待预读的扇区组成的环形队列
+static size_t ahead_head;                                 // 队首在ahead_queue中的下标
+static size_t ahead_cnt;                                  // 队列中扇区的数量
+static struct lock ahead_lock;                            // 预读队列的同步锁
+static struct condition ahead_ready;                      // 等待预读队列非空
+
+// 以Cache块对应的扇区号作为哈希值
+static unsigned
+cache_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+    return hash_int(hash_entry(e, struct disk_cache, hash_elem)->disk_sector);
+}
+
+// 按照扇区号比较dirty_list中的两个Cache块
+static bool
+dirty_less(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED)
+{
+    return list_entry(a, struct disk_cache, dirty_elem)->disk_sector <
+           list_entry(b, struct disk_cache, dirty_elem)->disk_sector;
+}
+
+// 将Cache块标记为脏块并按扇区号插入dirty_list
+// 属于尚未提交的事务的块不能写回原位置，因此不能成为脏块
+static void
+mark_dirty(struct disk_cache *entry)
+{
+    ASSERT(!entry->journaled);
+    if (!entry->dirty)
+    {
+        entry->dirty = true;
+        list_insert_ordered(&dirty_list, &entry->dirty_elem, dirty_less, NULL);
+        dirty_cnt++;
+    }
+}
+
+// 清除Cache块的脏标记并将其移出dirty_list
+static void
+clear_dirty(struct disk_cache *entry)
+{
+    if (entry->dirty)
+    {
+        entry->dirty = false;
+        list_remove(&entry->dirty_elem);
+        dirty_cnt--;
+    }
+}
+
+// 按照扇区号比较两个Cache块
+static bool
+cache_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
+{
+    return hash_entry(a, struct disk_cache, hash_elem)->disk_sector <
+           hash_entry(b, struct disk_cache, hash_elem)->disk_sector;
+}
+
 void init_entry(int idx)
 {
+    // 如果该块仍然缓存着某个扇区那么将其移出哈希索引并挂回空闲链表
+    if (!cache_array[idx].is_free)
+    {
+        hash_delete(&cache_map, &cache_array[idx].hash_elem);
+        list_push_back(&free_entries, &cache_array[idx].free_elem);
+    }
+    clear_dirty(&cache_array[idx]);
     cache_array[idx].is_free = true;
     cache_array[idx].open_cnt = 0;
-    cache_array[idx].dirty = false;
     cache_array[idx].accessed = false;
+    cache_array[idx].loading = false;
+    cache_array[idx].writing = false;
+    cache_array[idx].evicting = false;
+    cache_array[idx].journaled = false;
 }
 
 void init_cache(void)
 {
-    int i;
+    size_t i;
+
+    if (cache_size < CACHE_MIN_SIZE)
+        cache_size = CACHE_MIN_SIZE;
+    if (cache_size > CACHE_MAX_SIZE)
+        cache_size = CACHE_MAX_SIZE;
+    // 从内核内存池中分配Cache数组，如果内存不足那么减小Cache数组的大小后重试
+    for (;;)
+    {
+        size_t page_cnt = DIV_ROUND_UP(cache_size * sizeof *cache_array, PGSIZE);
+        cache_array = palloc_get_multiple(PAL_ZERO, page_cnt);
+        if (cache_array != NULL)
+            break;
+        if (cache_size / 2 < CACHE_MIN_SIZE)
+            PANIC("buffer cache allocation failed");
+        cache_size /= 2;
+    }
+
     lock_init(&cache_lock); //
-    for (i = 0; i < CACHE_MAX_SIZE; i++)
+    cond_init(&cache_released);
+    list_init(&dirty_list);
+    dirty_cnt = 0;
+    list_init(&journal_list);
+    journal_cnt = 0;
+    if (!hash_init(&cache_map, cache_hash, cache_less, NULL))
+        PANIC("cache index creation failed");
+    list_init(&free_entries);
+    for (i = 0; i < cache_size; i++)
+    {
+        cache_array[i].is_free = true;
+        cache_array[i].dirty = false;
+        cond_init(&cache_array[i].io_done);
+        list_push_back(&free_entries, &cache_array[i].free_elem);
         init_entry(i);
+    }
     thread_create("cache_writeback", 0, func_periodic_writer, NULL);
+
+    lock_init(&ahead_lock);
+    cond_init(&ahead_ready);
+    for (i = 0; i < READ_AHEAD_WORKERS; i++)
+        thread_create("cache_read_ahead", PRI_DEFAULT, func_read_ahead, NULL);
 }
 
 int get_cache_entry(block_sector_t disk_sector)
 {
-    int i;
-    for (i = 0; i < CACHE_MAX_SIZE; i++)
+    struct hash_elem *e;
+
+    map_key.disk_sector = disk_sector;
+    e = hash_find(&cache_map, &map_key.hash_elem);
+    if (e == NULL)
+        return -1;
+    return hash_entry(e, struct disk_cache, hash_elem) - cache_array;
+}
+
+int get_free_entry(void)
+{
+    struct disk_cache *entry;
+
+    if (list_empty(&free_entries))
+        return -1;
+
+    entry = list_entry(list_pop_front(&free_entries), struct disk_cache, free_elem);
+    entry->is_free = false;
+    return entry - cache_array;
+}
+
+int access_cache_entry(block_sector_t disk_sector)
+{
+    return fetch_entry(disk_sector, true);
+}
+
+int create_cache_entry(block_sector_t disk_sector)
+{
+    int idx = fetch_entry(disk_sector, false);
+    // 命中时块中可能还留有该扇区被释放前的内容
+    memset(cache_array[idx].block, 0, BLOCK_SECTOR_SIZE);
+    return idx;
+}
+
+static void journal_entry(struct disk_cache *entry);
+
+int access_meta_entry(block_sector_t disk_sector)
+{
+    int idx = fetch_entry(disk_sector, true);
+    join_meta_entry(idx);
+    return idx;
+}
+
+int create_meta_entry(block_sector_t disk_sector)
+{
+    int idx = fetch_entry(disk_sector, false);
+    join_meta_entry(idx);
+    memset(cache_array[idx].block, 0, BLOCK_SECTOR_SIZE);
+    return idx;
+}
+
+// 查找并固定指定扇区的Cache块，未命中时根据load决定是否从磁盘读入
+static int
+fetch_entry(block_sector_t disk_sector, bool load)
+{
+    int idx;
+    lock_acquire(&cache_lock); //
+
+    for (;;)
     {
-        if (cache_array[i].disk_sector == disk_sector)
+        idx = get_cache_entry(disk_sector);
+        if (idx == -1)
         {
-            if (!cache_array[i].is_free)
-            {
-                return i;
-            }
+            // 替换过程中释放过cache_lock，需要重新查找
+            idx = replace_cache_entry(disk_sector, load);
+            if (idx == -1)
+                continue;
+            while (cache_array[idx].loading)
+                cond_wait(&cache_array[idx].io_done, &cache_lock);
+            break;
         }
+
+        struct disk_cache *entry = &cache_array[idx];
+        // 该块正在被替换为其他扇区，等待替换完成后重新查找
+        if (entry->evicting)
+        {
+            cond_wait(&entry->io_done, &cache_lock);
+            continue;
+        }
+
+        // 先固定该块使其不会被替换，再等待其他线程将扇区读入
+        entry->open_cnt++;
+        entry->accessed = true;
+        while (entry->loading)
+            cond_wait(&entry->io_done, &cache_lock);
+        break;
+    }
+
+    lock_release(&cache_lock); //
+    return idx;
+}
+
+void release_cache_entry(int idx, bool dirty)
+{
+    struct disk_cache *entry = &cache_array[idx];
+    lock_acquire(&cache_lock); //
+
+    ASSERT(entry->open_cnt > 0);
+    entry->accessed = true;
+    if (dirty)
+        mark_dirty(entry);
+    if (--entry->open_cnt == 0)
+        cond_broadcast(&cache_released, &cache_lock);
+
+    // 脏块过多时由写入者自己写回一部分脏块，从而限制写入速度
+    if (dirty && dirty_cnt > cache_size * cache_dirty_max / 100)
+        flush_dirty(cache_size * cache_dirty_background / 100);
+
+    lock_release(&cache_lock); //
+}
+
+// 时钟算法选出一个可以被替换的块，所有块都被固定或正在进行I/O时返回-1
+static int
+pick_victim(void)
+{
+    size_t scanned;
+    for (scanned = 0; scanned < 2 * cache_size; scanned++)
+    {
+        struct disk_cache *entry = &cache_array[clock_hand];
+        size_t i = clock_hand;
+        clock_hand = (clock_hand + 1) % cache_size;
+
+        // 如果当前块正在被使用、正在进行I/O或者属于尚未提交的事务那么跳过
+        if (entry->open_cnt > 0 || entry->loading || entry->writing || entry->evicting ||
+            entry->journaled)
+            continue;
+
+        // 如果当前块的使用位为1意味着最近被使用那么给予第二次机会
+        if (entry->accessed == true)
+            entry->accessed = false;
+        else // 否则进行替换
+            return i;
     }
     return -1;
 }
 
-int get_free_entry(void)
+int replace_cache_entry(block_sector_t disk_sector, bool load)
 {
-    int i;
-    for (i = 0; i < CACHE_MAX_SIZE; i++)
+    int idx = get_free_entry();
+    struct disk_cache *entry;
+
+    if (idx == -1) // 如果Cache数组以及满了那么就执行加强版时钟算法进行Cache块的替换
     {
-        if (cache_array[i].is_free == true)
+        idx = pick_victim();
+        if (idx == -1)
         {
-            cache_array[i].is_free = false;
-            return i;
+            // 所有块都被固定，等待某个块被释放
+            cond_wait(&cache_released, &cache_lock);
+            return -1;
         }
+        entry = &cache_array[idx];
+
+        // 如果当前块的dirty位为true意味着被修改那么就提交写请求并等待当前块写回磁盘
+        if (entry->dirty == true)
+        {
+            entry->evicting = true;
+            clear_dirty(entry);
+            submit_io(entry, true);
+            while (entry->writing)
+                cond_wait(&entry->io_done, &cache_lock);
+            entry->evicting = false;
+            cond_broadcast(&entry->io_done, &cache_lock);
+
+            // 写回期间其他线程可能已经读入了该扇区，那么放弃该块并重新查找
+            if (get_cache_entry(disk_sector) != -1)
+            {
+                init_entry(idx);
+                return -1;
+            }
+        }
+        hash_delete(&cache_map, &entry->hash_elem);
     }
 
-    return -1;
+    bind_entry(idx, disk_sector, load);
+    return idx;
 }
 
-int access_cache_entry(block_sector_t disk_sector, bool dirty)
+// 在持有cache_lock的情况下调用，将一个已经移出哈希索引的块绑定到disk_sector并固定
+// 需要读入扇区时只提交读请求而不等待，读入完成前loading为true，访问该块的线程会在io_done上等待
+static void
+bind_entry(int idx, block_sector_t disk_sector, bool load)
 {
+    struct disk_cache *entry = &cache_array[idx];
+
+    entry->disk_sector = disk_sector;
+    entry->is_free = false;
+    entry->open_cnt = 1;
+    entry->accessed = true;
+    hash_insert(&cache_map, &entry->hash_elem);
+
+    if (load)
+        submit_io(entry, false);
+    else
+        memset(entry->block, 0, BLOCK_SECTOR_SIZE);
+}
+
+// 异步读写请求完成时在块设备的分发线程中调用，唤醒等待该Cache块I/O完成的线程
+static void
+io_complete(struct block_request *request)
+{
+    struct disk_cache *entry = request->aux;
+
     lock_acquire(&cache_lock); //
+    entry->loading = false;
+    entry->writing = false;
+    cond_broadcast(&entry->io_done, &cache_lock);
+    lock_release(&cache_lock); //
+}
 
-    int idx = get_cache_entry(disk_sector);
-    if (idx == -1)
-        idx = replace_cache_entry(disk_sector, dirty);
+// 在持有cache_lock的情况下调用，为Cache块提交一个单扇区的异步读写请求
+// 请求完成前loading或writing为true，提交者需要在io_done上等待
+static void
+submit_io(struct disk_cache *entry, bool write)
+{
+    struct block_request *request = &entry->request;
+
+    ASSERT(!entry->writing && !entry->loading);
+    if (write)
+        entry->writing = true;
     else
+        entry->loading = true;
+    request->sector = entry->disk_sector;
+    request->cnt = 1;
+    request->buffer = entry->block;
+    request->write = write;
+    request->complete = io_complete;
+    request->aux = entry;
+    block_submit(fs_device, request);
+}
+
+// 在持有cache_lock并固定了entry的情况下调用，在调用者修改块之前将其加入日志的当前事务
+// 块从脏块链表中移出，此后其中未提交的修改不会被写回原位置；正在写回的是修改前的内容，等待其完成
+// 属于正在提交的事务的块已经被复制，同样加入当前事务，该事务提交前不能写回
+static void
+journal_entry(struct disk_cache *entry)
+{
+    struct thread *t = thread_current();
+
+    while (entry->writing)
+        cond_wait(&entry->io_done, &cache_lock);
+    if (!journaling || (entry->journaled && entry->journal_tid == journal_tid))
+        return;
+
+    // journal_start为每个操作预留了块数，只有超过预留的操作才可能使事务超出日志区域的容量
+    if (journal_cnt >= JOURNAL_TXN_MAX)
+        PANIC("journal transaction overflow");
+    clear_dirty(entry);
+    entry->journaled = true;
+    entry->journal_tid = journal_tid;
+    list_push_back(&journal_list, &entry->journal_elem);
+    journal_cnt++;
+    if (t->journal_credits > 0)
     {
-        cache_array[idx].open_cnt++;
-        cache_array[idx].accessed = true;
-        cache_array[idx].dirty |= dirty;
+        t->journal_credits--;
+        journal_reserved--;
     }
+}
+
+void join_meta_entry(int idx)
+{
+    struct disk_cache *entry = &cache_array[idx];
+    lock_acquire(&cache_lock); //
 
+    ASSERT(entry->open_cnt > 0);
+    journal_entry(entry);
     lock_release(&cache_lock); //
-    return idx;
 }
 
-int replace_cache_entry(block_sector_t disk_sector, bool dirty)
+void release_meta_entry(int idx)
 {
-    int idx = get_free_entry();
-    int i = 0;
-    if (idx == -1) // 如果Cache数组以及满了那么就执行加强版时钟算法进行Cache块的替换
+    struct disk_cache *entry = &cache_array[idx];
+    lock_acquire(&cache_lock); //
+
+    ASSERT(entry->open_cnt > 0);
+    entry->accessed = true;
+    if (!journaling)
+        mark_dirty(entry);
+    if (--entry->open_cnt == 0)
+        cond_broadcast(&cache_released, &cache_lock);
+    lock_release(&cache_lock); //
+}
+
+void cache_write_meta(block_sector_t disk_sector, const void *buffer)
+{
+    int idx = fetch_entry(disk_sector, false);
+    struct disk_cache *entry = &cache_array[idx];
+    lock_acquire(&cache_lock); //
+
+    // 加入事务和复制都在cache_lock内进行，提交者不会复制到写入了一半的内容
+    journal_entry(entry);
+    memcpy(entry->block, buffer, BLOCK_SECTOR_SIZE);
+    entry->accessed = true;
+    if (!journaling)
+        mark_dirty(entry);
+    if (--entry->open_cnt == 0)
+        cond_broadcast(&cache_released, &cache_lock);
+    lock_release(&cache_lock); //
+}
+
+void cache_journal_enable(bool enable)
+{
+    lock_acquire(&cache_lock); //
+    journaling = enable;
+    lock_release(&cache_lock); //
+}
+
+bool cache_journal_reserve(size_t credits, size_t capacity)
+{
+    bool success;
+    lock_acquire(&cache_lock); //
+    success = journal_cnt + journal_reserved + credits <= capacity;
+    if (success)
+        journal_reserved += credits;
+    lock_release(&cache_lock); //
+    return success;
+}
+
+void cache_journal_unreserve(size_t credits)
+{
+    lock_acquire(&cache_lock); //
+    ASSERT(journal_reserved >= credits);
+    journal_reserved -= credits;
+    lock_release(&cache_lock); //
+}
+
+size_t cache_journal_snapshot(uint32_t *tidp, block_sector_t *sectors, uint8_t *data)
+{
+    size_t cnt = 0;
+    lock_acquire(&cache_lock); //
+
+    *tidp = journal_tid++;
+    while (!list_empty(&journal_list))
     {
-        for (i = 0;; i = (i + 1) % CACHE_MAX_SIZE)
+        struct disk_cache *entry = list_entry(list_pop_front(&journal_list), struct disk_cache, journal_elem);
+        sectors[cnt] = entry->disk_sector;
+        memcpy(data + cnt * BLOCK_SECTOR_SIZE, entry->block, BLOCK_SECTOR_SIZE);
+        cnt++;
+    }
+    ASSERT(cnt == journal_cnt && journal_reserved == 0);
+    journal_cnt = 0;
+
+    lock_release(&cache_lock); //
+    return cnt;
+}
+
+void cache_journal_done(uint32_t tid)
+{
+    size_t i;
+    lock_acquire(&cache_lock); //
+
+    // 之后又被新事务修改过的块仍然不能写回
+    for (i = 0; i < cache_size; i++)
+    {
+        struct disk_cache *entry = &cache_array[i];
+        if (entry->journaled && entry->journal_tid == tid)
         {
-            // 如果当前块正在被使用那么跳过
-            if (cache_array[i].open_cnt > 0)
-                continue;
+            entry->journaled = false;
+            mark_dirty(entry);
+        }
+    }
 
-            // 如果当前块的使用位为1意味着最近被使用那么给予第二次机会
-            if (cache_array[i].accessed == true)
-                cache_array[i].accessed = false;
+    lock_release(&cache_lock); //
+}
 
-            // 否则进行替换
-            else
-            {
-                // 如果当前块的dirty位为true意味着被修改那么就将当前块写回磁盘
-                if (cache_array[i].dirty == true)
-                    block_write(fs_device, cache_array[i].disk_sector,
-                                &cache_array[i].block);
-                // 重新初始化当前块
-                init_entry(i);
-                idx = i;
-                break;
-            }
+void cache_checkpoint(block_sector_t disk_sector, const void *data)
+{
+    struct disk_cache *entry;
+    int idx;
+    lock_acquire(&cache_lock); //
+
+    for (;;)
+    {
+        idx = get_cache_entry(disk_sector);
+        if (idx == -1)
+            break; // 不在Cache中，被替换时已经写回了不旧于data的内容
+        entry = &cache_array[idx];
+        if (entry->loading || entry->writing || entry->evicting)
+        {
+            cond_wait(&entry->io_done, &cache_lock);
+            continue;
         }
+
+        if (entry->journaled)
+        {
+            // 块中有更新的事务尚未提交的修改，原位置只能写入已提交的内容data
+            // 更新的事务在本次检查点之后才会提交，因此释放cache_lock期间该块不会被写回
+            lock_release(&cache_lock); //
+            block_write(fs_device, disk_sector, data);
+            return;
+        }
+        if (entry->dirty)
+        {
+            // Cache中的内容不旧于data，直接写回该块
+            clear_dirty(entry);
+            entry->open_cnt++;
+            submit_io(entry, true);
+            while (entry->writing)
+                cond_wait(&entry->io_done, &cache_lock);
+            if (--entry->open_cnt == 0)
+                cond_broadcast(&cache_released, &cache_lock);
+        }
+        break;
     }
 
-    cache_array[idx].disk_sector = disk_sector;
-    cache_array[idx].is_free = false;
-    cache_array[idx].open_cnt++;
-    cache_array[idx].accessed = true;
-    cache_array[idx].dirty = dirty;
-    block_read(fs_device, cache_array[idx].disk_sector, &cache_array[idx].block); //
+    lock_release(&cache_lock); //
+}
 
-    return idx;
+void cache_read(block_sector_t disk_sector, void *buffer)
+{
+    int idx = access_cache_entry(disk_sector);
+    memcpy(buffer, cache_array[idx].block, BLOCK_SECTOR_SIZE);
+    release_cache_entry(idx, false);
+}
+
+void cache_write(block_sector_t disk_sector, const void *buffer)
+{
+    int idx = fetch_entry(disk_sector, false);
+    memcpy(cache_array[idx].block, buffer, BLOCK_SECTOR_SIZE);
+    release_cache_entry(idx, true);
 }
 
 void func_periodic_writer(void *aux UNUSED)
 {
+    int64_t last_flush = timer_ticks();
     while (true)
     {
-        timer_sleep(4 * TIMER_FREQ);
-        write_back(false);
+        timer_msleep(CACHE_FLUSH_POLL);
+
+        // 距离上次写回超过cache_flush_interval毫秒或脏块超过后台写回阈值时写回
+        if (timer_elapsed(last_flush) * 1000 >= (int64_t)cache_flush_interval * TIMER_FREQ)
+        {
+            // 先提交元数据日志的当前事务，其中包括空闲扇区位图中被修改的扇区，然后与其他脏块一起写回
+            journal_commit();
+            lock_acquire(&cache_lock); //
+            flush_dirty(0);
+            lock_release(&cache_lock); //
+            last_flush = timer_ticks();
+        }
+        else
+        {
+            lock_acquire(&cache_lock); //
+            if (dirty_cnt > cache_size * cache_dirty_background / 100)
+                flush_dirty(cache_size * cache_dirty_background / 100);
+            lock_release(&cache_lock); //
+        }
     }
 }
 
-void write_back(bool clear)
+// 在持有cache_lock的情况下调用，按照扇区号升序写回脏块直到脏块数量不超过target
+// 每次为至多CACHE_FLUSH_BATCH个脏块同时提交写请求，等待期间释放cache_lock并固定这些块
+// 写回期间重新变脏的块留给下一次写回，因此持续写入时该函数也会结束
+// 块在写请求完成前可能被再次修改而重新变脏，此时先等待上一次写回完成，同一个请求不能重复提交
+static void
+flush_dirty(size_t target)
 {
-    int i;
-    lock_acquire(&cache_lock); //
-
-    for (i = 0; i < CACHE_MAX_SIZE; i++)
+    size_t budget = dirty_cnt;
+    while (dirty_cnt > target && budget > 0)
     {
-        if (cache_array[i].dirty == true)
+        struct disk_cache *batch[CACHE_FLUSH_BATCH];
+        size_t cnt = 0;
+        size_t i;
+
+        while (cnt < CACHE_FLUSH_BATCH && dirty_cnt > target && budget > 0)
         {
-            block_write(fs_device, cache_array[i].disk_sector, &cache_array[i].block);
-            cache_array[i].dirty = false;
+            struct disk_cache *entry = list_entry(list_front(&dirty_list), struct disk_cache, dirty_elem);
+            if (entry->writing)
+            {
+                cond_wait(&entry->io_done, &cache_lock);
+                continue;
+            }
+            clear_dirty(entry);
+            entry->open_cnt++;
+            submit_io(entry, true);
+            batch[cnt++] = entry;
+            budget--;
         }
 
-        // 在filesystem done的时候将缓存块清空
-        if (clear)
+        for (i = 0; i < cnt; i++)
         {
-            init_entry(i);
+            while (batch[i]->writing)
+                cond_wait(&batch[i]->io_done, &cache_lock);
+            if (--batch[i]->open_cnt == 0)
+                cond_broadcast(&cache_released, &cache_lock);
         }
     }
+}
+
+void write_back(bool clear)
+{
+    size_t i;
+    lock_acquire(&cache_lock); //
+
+    flush_dirty(0);
+
+    // 在filesystem done的时候将缓存块清空
+    if (clear)
+        for (i = 0; i < cache_size; i++)
+        {
+            struct disk_cache *entry = &cache_array[i];
+            if (entry->open_cnt == 0 && !entry->dirty && !entry->loading &&
+                !entry->writing && !entry->evicting && !entry->journaled)
+                init_entry(i);
+        }
 
     lock_release(&cache_lock); //
 }
 
-void func_read_ahead(void *aux)
+// 选出一个未被固定、未被修改且近期未被访问的块用于预读，不清除任何块的访问位，找不到时返回-1
+static int
+pick_cold_entry(void)
 {
-    block_sector_t disk_sector = *(block_sector_t *)aux;
-    lock_acquire(&cache_lock); //
+    size_t scanned, i = clock_hand;
+    for (scanned = 0; scanned < cache_size; scanned++, i = (i + 1) % cache_size)
+    {
+        struct disk_cache *entry = &cache_array[i];
+        if (entry->open_cnt == 0 && !entry->accessed && !entry->dirty &&
+            !entry->loading && !entry->writing && !entry->evicting)
+            return i;
+    }
+    return -1;
+}
 
-    int idx = get_cache_entry(disk_sector);
+// 将指定扇区预读到Cache中，只使用空闲块或冷块，没有合适的块时放弃本次预读
+static void
+prefetch_entry(block_sector_t disk_sector)
+{
+    int idx;
+    lock_acquire(&cache_lock); //
 
-    // 需要置换
-    if (idx == -1)
-        replace_cache_entry(disk_sector, false);
+    if (get_cache_entry(disk_sector) == -1)
+    {
+        idx = get_free_entry();
+        if (idx == -1)
+        {
+            idx = pick_cold_entry();
+            if (idx != -1)
+                hash_delete(&cache_map, &cache_array[idx].hash_elem);
+        }
+        if (idx != -1)
+        {
+            // 只提交读请求而不等待读入完成，预读线程可以继续处理队列中的其他扇区
+            bind_entry(idx, disk_sector, true);
+            // 预读的块还未被真正访问过，如果一直没有被读取那么会被优先替换
+            cache_array[idx].accessed = false;
+            if (--cache_array[idx].open_cnt == 0)
+                cond_broadcast(&cache_released, &cache_lock);
+        }
+    }
 
     lock_release(&cache_lock); //
-    free(aux);
+}
+
+void func_read_ahead(void *aux UNUSED)
+{
+    while (true)
+    {
+        block_sector_t disk_sector;
+
+        lock_acquire(&ahead_lock);
+        while (ahead_cnt == 0)
+            cond_wait(&ahead_ready, &ahead_lock);
+        disk_sector = ahead_queue[ahead_head];
+        ahead_head = (ahead_head + 1) % READ_AHEAD_QUEUE_SIZE;
+        ahead_cnt--;
+        lock_release(&ahead_lock);
+
+        prefetch_entry(disk_sector);
+    }
 }
 
 void ahead_reader(block_sector_t disk_sector)
 {
-    block_sector_t *arg = malloc(sizeof(block_sector_t));
-    *arg = disk_sector + 1; // next block
-    thread_create("cache_read_ahead", 0, func_read_ahead, arg);
+    lock_acquire(&ahead_lock);
+    // 队列已满时直接丢弃本次预读请求
+    if (ahead_cnt < READ_AHEAD_QUEUE_SIZE)
+    {
+        ahead_queue[(ahead_head + ahead_cnt) % READ_AHEAD_QUEUE_SIZE] = disk_sector;
+        ahead_cnt++;
+        cond_signal(&ahead_ready, &ahead_lock);
+    }
+    lock_release(&ahead_lock);
 }
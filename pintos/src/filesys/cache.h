@@ -1,11 +1,24 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
 
+#include <hash.h>
+#include <list.h>
 #include "devices/block.h"
 #include "devices/timer.h"
 #include "threads/synch.h"
 
-#define CACHE_MAX_SIZE 64 // 最大Cache数组大小
+#define CACHE_DEFAULT_SIZE 64 // 默认的Cache数组大小，可通过内核命令行-cache=N修改
+#define CACHE_MIN_SIZE 16     // Cache数组大小的下限
+#define CACHE_MAX_SIZE 8192   // Cache数组大小的上限
+
+#define CACHE_FLUSH_INTERVAL 4000 // 默认的定期写回间隔（毫秒），可通过-cache-flush=MS修改
+#define CACHE_FLUSH_POLL 100      // 写回线程检查脏块数量的间隔（毫秒）
+#define CACHE_DIRTY_BACKGROUND 10 // 默认的后台写回阈值（脏块占Cache的百分比），可通过-cache-dirty=PCT修改
+#define CACHE_DIRTY_MAX 40        // 默认的写入限流阈值（脏块占Cache的百分比），可通过-cache-dirty-max=PCT修改
+#define CACHE_FLUSH_BATCH 16      // 一次写回最多同时提交的写请求数量，相邻扇区的请求由块设备队列合并
+
+#define READ_AHEAD_WORKERS 2     // 预读工作线程的数量
+#define READ_AHEAD_QUEUE_SIZE 64 // 预读队列的容量
 // Cache块
 struct disk_cache
 {
@@ -17,30 +30,79 @@ struct disk_cache
     int open_cnt;  // 该Cache块被访问/打开的次数
     bool accessed; // Cache块是否被访问
     bool dirty;    // 该Cache块是否被写入
+
+    bool loading;            // 该Cache块正在从磁盘读入，其内容尚不可用
+    bool writing;            // 该Cache块正在被写回磁盘，内容仍然可用
+    bool evicting;           // 该Cache块正在被替换，写回完成后将缓存其他扇区
+    struct condition io_done; // 等待该Cache块的磁盘I/O完成，与cache_lock配合使用
+    struct block_request request; // 该Cache块正在进行的异步读写请求
+
+    bool journaled;                // 被尚未写入日志的事务修改过，事务提交前不能写回原位置，也不能被替换
+    uint32_t journal_tid;          // 最近一次修改该块的事务编号
+    struct list_elem journal_elem; // 当前事务的块链表中的元素
+
+    struct list_elem dirty_elem; // 按扇区号排序的脏块链表中的元素
+    struct hash_elem hash_elem; // 扇区号到Cache块的哈希索引中的元素
+    struct list_elem free_elem; // 空闲Cache块链表中的元素
 };
 
-struct lock cache_lock;            // Cache的同步锁
-struct disk_cache cache_array[64]; // Cache块组成的数组
+extern struct lock cache_lock;          // Cache的同步锁
+extern struct disk_cache *cache_array;  // Cache块组成的数组，在init_cache时从palloc分配
+extern size_t cache_size;               // Cache数组中块的数量
+extern unsigned cache_flush_interval;   // 定期写回的间隔（毫秒）
+extern unsigned cache_dirty_background; // 脏块超过该百分比时写回线程提前写回
+extern unsigned cache_dirty_max;        // 脏块超过该百分比时写入者需要自己写回脏块
 
 // 初始化Cache数组中的每一块
 void init_entry(int idx);
-// 初始化Cache数组同时初始化Cache的同步锁
+// 按照cache_size分配并初始化Cache数组同时初始化Cache的同步锁，内存不足时减半重试
 void init_cache(void);
-// 根据磁盘中的扇区号获取Cache数组中对应块的索引
+// 根据磁盘中的扇区号通过哈希索引获取Cache数组中对应块的索引
 int get_cache_entry(block_sector_t disk_sector);
-// 获取Cache数组中当前空闲的块
+// 从空闲链表中获取Cache数组中当前空闲的块
 int get_free_entry(void);
-// 访问指定扇区的Cache块并修改其对应的属性，如果不存在该扇区的Cache块那么就替换一个Cache块再修改
-int access_cache_entry(block_sector_t disk_sector, bool dirty);
-// Cache块的替换算法，基于访问位和修改位的时钟算法，性能最接近LRU
-int replace_cache_entry(block_sector_t disk_sector, bool dirty);
-// 每隔四个TIMER_FREQ将缓冲区中的数据写回磁盘
+// 访问指定扇区的Cache块并将其固定，如果不存在该扇区的Cache块那么就替换一个Cache块，返回时块中的数据可用
+int access_cache_entry(block_sector_t disk_sector);
+// 固定指定扇区的Cache块并将其内容清零，不从磁盘读入，用于新分配的还未写入过的扇区
+int create_cache_entry(block_sector_t disk_sector);
+// 释放对Cache块的固定，如果调用者修改了块中的数据那么dirty为true
+void release_cache_entry(int idx, bool dirty);
+// Cache块的替换算法，基于访问位和修改位的时钟算法，性能最接近LRU；磁盘I/O期间不持有cache_lock，返回-1表示需要重新查找
+// load为false时调用者将覆盖整个扇区，因此不从磁盘读入而是将块清零
+int replace_cache_entry(block_sector_t disk_sector, bool load);
+// 与access_cache_entry相同，但在返回之前将块加入日志的当前事务，调用者随后修改其中的元数据
+int access_meta_entry(block_sector_t disk_sector);
+// 与create_cache_entry相同，但在清零之前将块加入日志的当前事务
+int create_meta_entry(block_sector_t disk_sector);
+// 将已经固定的元数据块加入日志的当前事务，必须在修改块的内容之前调用
+void join_meta_entry(int idx);
+// 释放对元数据块的固定，块中的修改属于日志的当前事务，事务提交后才会写回；不记录日志时与release_cache_entry(idx, true)相同
+void release_meta_entry(int idx);
+// 通过Cache将buffer写入整个元数据扇区，由日志负责其写回
+void cache_write_meta(block_sector_t disk_sector, const void *buffer);
+// 开始或停止将元数据块加入日志的事务
+void cache_journal_enable(bool enable);
+// 为一个日志操作预留credits个块，当前事务中的块数与所有预留之和不能超过capacity，否则返回false
+bool cache_journal_reserve(size_t credits, size_t capacity);
+// 归还日志操作结束时尚未使用的预留
+void cache_journal_unreserve(size_t credits);
+// 复制当前事务中每个块的扇区号和内容并开始一个新的事务，返回块的数量，*tidp为被复制的事务的编号
+size_t cache_journal_snapshot(uint32_t *tidp, block_sector_t *sectors, uint8_t *data);
+// 编号为tid的事务已经写入日志，其中的块可以写回原位置
+void cache_journal_done(uint32_t tid);
+// 检查点：保证扇区在已提交事务中的内容data或者更新的已提交内容已经写回原位置
+void cache_checkpoint(block_sector_t disk_sector, const void *data);
+// 通过Cache读取整个扇区到buffer中
+void cache_read(block_sector_t disk_sector, void *buffer);
+// 通过Cache将buffer写入整个扇区，不需要先从磁盘读入该扇区
+void cache_write(block_sector_t disk_sector, const void *buffer);
+// 每隔cache_flush_interval毫秒或者脏块超过后台写回阈值时将缓冲区中的数据写回磁盘
 void func_periodic_writer(void *aux);
-// 将Cache数组中所有dirty为true即被修改过的Cache块写回磁盘并更新dirty为false，根据是否clear来确定是否将该缓存快初始化
+// 按照扇区号升序将所有被修改过的Cache块写回磁盘并更新dirty为false，根据是否clear来确定是否将该缓存快初始化
 void write_back(bool clear);
-// 预取策略，如果Cache数组中没有指定扇区块那么替换一个Cache块
+// 预读工作线程，不断从预读队列中取出扇区并读入Cache，不会替换被固定或近期被访问的块
 void func_read_ahead(void *aux);
-// 预取当前块的下一块到缓存区中
+// 将指定扇区加入预读队列，队列已满时丢弃该请求
 void ahead_reader(block_sector_t);
 
 #endif
@@ -2,9 +2,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir
@@ -21,6 +24,196 @@ struct dir_entry
   bool in_use;                 /* In use or free? */
 };
 
+// 目录有两种格式：
+// 线性格式中dir_entry从偏移0开始依次排列，查找时需要逐个比较
+// 哈希格式（htree）以BLOCK_SECTOR_SIZE字节为一块，第0块是根索引块，其余为索引节点块或叶子块
+// 根索引块和索引节点块中按哈希值升序记录每个哈希区间所在的块，叶子块存放DX_LEAF_SLOTS个dir_entry
+// 线性目录超过一块时转换为哈希格式，查找和插入只需要访问一个叶子块
+#define DX_ROOT_MAGIC 0x48534944 // 哈希目录根索引块的第一个字，不可能是线性目录中的扇区编号
+#define DX_NODE_MAGIC 0x4e534944 // 索引节点块的第一个字
+#define DX_ROOT_CNT 62           // 根索引块中索引项的最大数量
+#define DX_NODE_CNT 63           // 索引节点块中索引项的最大数量
+#define DX_LEAF_SLOTS (BLOCK_SECTOR_SIZE / sizeof(struct dir_entry)) // 每个叶子块中dir_entry的数量
+#define DX_LEAF_HINT_OFS (DX_LEAF_SLOTS * sizeof(struct dir_entry))  // 叶子块中空闲槽位提示所在的偏移
+
+// 索引项：哈希值不小于hash的目录项存放在块block（或其下的叶子块）中，直到下一个索引项
+struct dx_entry
+{
+  uint32_t hash;  // 该区间的最小哈希值
+  uint32_t block; // 叶子块或索引节点块的块号
+};
+
+// 根索引块
+struct dx_root
+{
+  uint32_t magic;                        // DX_ROOT_MAGIC
+  uint32_t levels;                       // 为0时索引项指向叶子块，为1时指向索引节点块
+  uint32_t cnt;                          // 索引项的数量
+  uint32_t unused;                       // 未使用
+  struct dx_entry entries[DX_ROOT_CNT];  // 索引项
+};
+
+// 索引节点块
+struct dx_node
+{
+  uint32_t magic;                        // DX_NODE_MAGIC
+  uint32_t cnt;                          // 索引项的数量
+  struct dx_entry entries[DX_NODE_CNT];  // 索引项
+};
+
+// 目录文件中的一个索引项数组，可能位于根索引块或索引节点块中
+struct dx_array
+{
+  off_t cnt_ofs;     // 索引项数量所在的偏移
+  off_t entries_ofs; // 第一个索引项所在的偏移
+  uint32_t limit;    // 索引项的最大数量
+};
+
+// 从根索引块到叶子块的查找路径
+struct dx_path
+{
+  uint32_t root_pos; // 根索引块中的索引项下标
+  uint32_t node;     // 索引节点块的块号，levels为0时为0
+  uint32_t node_pos; // 索引节点块中的索引项下标
+  uint32_t leaf;     // 叶子块的块号
+};
+
+// 目录项缓存：以（父目录inode扇区号，名称）为键记录查找结果，路径解析中重复的查找不需要再扫描目录
+// 不存在的名称以扇区号0缓存为否定项，扇区0是空闲扇区位图的inode，不可能出现在目录中
+// 缓存由目录inode的锁保证与目录内容一致，dir_add和dir_remove在修改目录后同步更新缓存
+#define DCACHE_SIZE 256 // 目录项缓存的容量
+
+// 目录项缓存中的一项
+struct dentry
+{
+  block_sector_t parent;      // 父目录inode的扇区号
+  char name[NAME_MAX + 1];    // 名称
+  block_sector_t sector;      // 对应文件inode的扇区号，为0时表示名称不存在
+  struct hash_elem hash_elem; // dcache_map中的元素
+  struct list_elem lru_elem;  // dcache_lru或dcache_free中的元素
+};
+
+static struct dentry dcache[DCACHE_SIZE]; // 目录项缓存
+static struct hash dcache_map;            // （父目录，名称）到缓存项的哈希索引
+static struct list dcache_lru;            // 使用中的缓存项，最近使用的在前
+static struct list dcache_free;           // 空闲的缓存项
+static struct dentry dcache_key;          // 查找哈希索引时使用的键，受dcache_lock保护
+static struct lock dcache_lock;           // 目录项缓存的同步锁
+
+// 由父目录扇区号和名称计算哈希值
+static unsigned
+dentry_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry(e, struct dentry, hash_elem);
+  return hash_string(d->name) ^ hash_int(d->parent);
+}
+
+// 比较两个缓存项的键
+static bool
+dentry_less(const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry(a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry(b_, struct dentry, hash_elem);
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp(a->name, b->name) < 0;
+}
+
+// 初始化目录项缓存
+void dir_init(void)
+{
+  size_t i;
+
+  lock_init(&dcache_lock);
+  hash_init(&dcache_map, dentry_hash, dentry_less, NULL);
+  list_init(&dcache_lru);
+  list_init(&dcache_free);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    list_push_back(&dcache_free, &dcache[i].lru_elem);
+}
+
+// 查找（parent，name）对应的缓存项，找到时将其移到LRU链表的前端，调用者需持有dcache_lock
+static struct dentry *
+dcache_find(block_sector_t parent, const char *name)
+{
+  struct hash_elem *e;
+  struct dentry *d;
+
+  dcache_key.parent = parent;
+  strlcpy(dcache_key.name, name, sizeof dcache_key.name);
+  e = hash_find(&dcache_map, &dcache_key.hash_elem);
+  if (e == NULL)
+    return NULL;
+  d = hash_entry(e, struct dentry, hash_elem);
+  list_remove(&d->lru_elem);
+  list_push_front(&dcache_lru, &d->lru_elem);
+  return d;
+}
+
+// 在缓存中查找目录parent下名为name的文件，命中时将扇区号（不存在时为0）存入*sectorp并返回true
+static bool
+dcache_get(block_sector_t parent, const char *name, block_sector_t *sectorp)
+{
+  struct dentry *d;
+
+  if (strlen(name) > NAME_MAX)
+    return false;
+  lock_acquire(&dcache_lock);
+  d = dcache_find(parent, name);
+  if (d != NULL)
+    *sectorp = d->sector;
+  lock_release(&dcache_lock);
+  return d != NULL;
+}
+
+// 记录目录parent下名为name的文件位于扇区sector，sector为0时记录为否定项，缓存已满时淘汰最久未使用的项
+static void
+dcache_put(block_sector_t parent, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen(name) > NAME_MAX)
+    return;
+  lock_acquire(&dcache_lock);
+  d = dcache_find(parent, name);
+  if (d == NULL)
+  {
+    if (!list_empty(&dcache_free))
+      d = list_entry(list_pop_front(&dcache_free), struct dentry, lru_elem);
+    else
+    {
+      d = list_entry(list_pop_back(&dcache_lru), struct dentry, lru_elem);
+      hash_delete(&dcache_map, &d->hash_elem);
+    }
+    d->parent = parent;
+    strlcpy(d->name, name, sizeof d->name);
+    hash_insert(&dcache_map, &d->hash_elem);
+    list_push_front(&dcache_lru, &d->lru_elem);
+  }
+  d->sector = sector;
+  lock_release(&dcache_lock);
+}
+
+// 删除父目录为parent的所有缓存项，用于目录被删除之后，避免其扇区被重新使用时命中旧的缓存项
+static void
+dcache_purge(block_sector_t parent)
+{
+  size_t i;
+
+  lock_acquire(&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+  {
+    struct dentry *d = &dcache[i];
+    if (d->parent == parent && hash_find(&dcache_map, &d->hash_elem) == &d->hash_elem)
+    {
+      hash_delete(&dcache_map, &d->hash_elem);
+      list_remove(&d->lru_elem);
+      list_push_back(&dcache_free, &d->lru_elem);
+    }
+  }
+  lock_release(&dcache_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 // 修改inode_create的调用
@@ -82,22 +275,167 @@ dir_get_inode(struct dir *dir)
   return dir->inode;
 }
 
+// 读取目录文件中偏移ofs处的一个字，超出文件末尾时返回0
+static uint32_t
+read_word(struct inode *inode, off_t ofs)
+{
+  uint32_t word = 0;
+  inode_read_at(inode, &word, sizeof word, ofs);
+  return word;
+}
+
+// 向目录文件中偏移ofs处写入一个字
+static bool
+write_word(struct inode *inode, off_t ofs, uint32_t word)
+{
+  return inode_write_at(inode, &word, sizeof word, ofs) == sizeof word;
+}
+
+// 判断目录是否为哈希格式
+static bool
+is_hashed(struct inode *inode)
+{
+  return read_word(inode, 0) == DX_ROOT_MAGIC;
+}
+
+// 目录项名称的哈希值
+static uint32_t
+name_hash(const char *name)
+{
+  return hash_string(name);
+}
+
+// 叶子块block中第slot个dir_entry的偏移
+static off_t
+slot_ofs(uint32_t block, size_t slot)
+{
+  return block * BLOCK_SECTOR_SIZE + slot * sizeof(struct dir_entry);
+}
+
+// 根索引块中的索引项数组
+static struct dx_array
+root_array(void)
+{
+  struct dx_array a;
+  a.cnt_ofs = offsetof(struct dx_root, cnt);
+  a.entries_ofs = offsetof(struct dx_root, entries);
+  a.limit = DX_ROOT_CNT;
+  return a;
+}
+
+// 索引节点块block中的索引项数组
+static struct dx_array
+node_array(uint32_t block)
+{
+  struct dx_array a;
+  a.cnt_ofs = block * BLOCK_SECTOR_SIZE + offsetof(struct dx_node, cnt);
+  a.entries_ofs = block * BLOCK_SECTOR_SIZE + offsetof(struct dx_node, entries);
+  a.limit = DX_NODE_CNT;
+  return a;
+}
+
+// 读取索引项数组a中的第i个索引项
+static struct dx_entry
+array_get(struct inode *inode, const struct dx_array *a, uint32_t i)
+{
+  struct dx_entry e;
+  memset(&e, 0, sizeof e);
+  inode_read_at(inode, &e, sizeof e, a->entries_ofs + i * sizeof e);
+  return e;
+}
+
+// 在索引项数组a中二分查找覆盖哈希值hash的索引项下标，即最后一个hash不大于该值的索引项
+static uint32_t
+array_search(struct inode *inode, const struct dx_array *a, uint32_t hash)
+{
+  uint32_t lo = 0, hi = read_word(inode, a->cnt_ofs);
+  while (hi - lo > 1)
+  {
+    uint32_t mid = (lo + hi) / 2;
+    if (array_get(inode, a, mid).hash <= hash)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// 将索引项e插入到索引项数组a的下标pos处，数组必须还有空位
+static bool
+array_insert(struct inode *inode, const struct dx_array *a, uint32_t pos, struct dx_entry e)
+{
+  uint32_t cnt = read_word(inode, a->cnt_ofs);
+  uint32_t i;
+
+  ASSERT(cnt < a->limit && pos <= cnt);
+  for (i = cnt; i > pos; i--)
+  {
+    struct dx_entry prev = array_get(inode, a, i - 1);
+    if (inode_write_at(inode, &prev, sizeof prev, a->entries_ofs + i * sizeof prev) != sizeof prev)
+      return false;
+  }
+  return inode_write_at(inode, &e, sizeof e, a->entries_ofs + pos * sizeof e) == sizeof e &&
+         write_word(inode, a->cnt_ofs, cnt + 1);
+}
+
+// 在哈希目录的末尾追加一个块，内容为buffer，返回其块号，失败时返回0
+static uint32_t
+append_block(struct inode *inode, const void *buffer)
+{
+  uint32_t block = DIV_ROUND_UP(inode_length(inode), BLOCK_SECTOR_SIZE);
+  if (inode_write_at(inode, buffer, BLOCK_SECTOR_SIZE, block * BLOCK_SECTOR_SIZE) != BLOCK_SECTOR_SIZE)
+    return 0;
+  return block;
+}
+
+// 沿着根索引块（和索引节点块）找到哈希值hash所在的叶子块
+static void
+dx_find(struct inode *inode, uint32_t hash, struct dx_path *path)
+{
+  struct dx_array root = root_array();
+  struct dx_entry e;
+
+  path->root_pos = array_search(inode, &root, hash);
+  e = array_get(inode, &root, path->root_pos);
+  path->node = 0;
+  path->node_pos = 0;
+  if (read_word(inode, offsetof(struct dx_root, levels)) > 0)
+  {
+    struct dx_array node = node_array(e.block);
+    path->node = e.block;
+    path->node_pos = array_search(inode, &node, hash);
+    e = array_get(inode, &node, path->node_pos);
+  }
+  path->leaf = e.block;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
    otherwise, returns false and ignores EP and OFSP. */
+// 哈希格式的目录只需要查找名称的哈希值所在的叶子块
 static bool
 lookup(const struct dir *dir, const char *name,
        struct dir_entry *ep, off_t *ofsp)
 {
   struct dir_entry e;
-  size_t ofs;
+  size_t ofs, end;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+  ofs = 0;
+  end = (size_t)-1;
+  if (is_hashed(dir->inode))
+  {
+    struct dx_path path;
+    dx_find(dir->inode, name_hash(name), &path);
+    ofs = slot_ofs(path.leaf, 0);
+    end = slot_ofs(path.leaf, DX_LEAF_SLOTS);
+  }
+
+  for (; ofs < end && inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e)
     if (e.in_use && !strcmp(name, e.name))
     {
@@ -110,23 +448,326 @@ lookup(const struct dir *dir, const char *name,
   return false;
 }
 
+// 从目录中偏移*posp处开始查找下一个正在使用的目录项，找到时存入ep并将*posp移动到其后
+// 哈希格式的目录跳过根索引块、索引节点块以及叶子块末尾的空闲槽位提示
+static bool
+next_entry(struct inode *inode, off_t *posp, struct dir_entry *ep)
+{
+  bool hashed = is_hashed(inode);
+  off_t pos = *posp;
+
+  for (;;)
+  {
+    if (hashed)
+    {
+      uint32_t block = pos / BLOCK_SECTOR_SIZE;
+      size_t slot = (pos % BLOCK_SECTOR_SIZE) / sizeof(struct dir_entry);
+
+      if (block == 0 || slot >= DX_LEAF_SLOTS ||
+          read_word(inode, block * BLOCK_SECTOR_SIZE) == DX_NODE_MAGIC)
+      {
+        pos = (block + 1) * BLOCK_SECTOR_SIZE;
+        if (pos >= inode_length(inode))
+          break;
+        continue;
+      }
+    }
+    if (inode_read_at(inode, ep, sizeof *ep, pos) != sizeof *ep)
+      break;
+    pos += sizeof *ep;
+    if (ep->in_use)
+    {
+      *posp = pos;
+      return true;
+    }
+  }
+  *posp = pos;
+  return false;
+}
+
+// 目录项名称的哈希值
+static uint32_t
+entry_hash(const struct dir_entry *e)
+{
+  return name_hash(e->name);
+}
+
+// 按照名称的哈希值对cnt个目录项进行插入排序
+static void
+sort_entries(struct dir_entry *entries, size_t cnt)
+{
+  size_t i, j;
+  for (i = 1; i < cnt; i++)
+  {
+    struct dir_entry e = entries[i];
+    uint32_t hash = entry_hash(&e);
+    for (j = i; j > 0 && entry_hash(&entries[j - 1]) > hash; j--)
+      entries[j] = entries[j - 1];
+    entries[j] = e;
+  }
+}
+
+// 将cnt个目录项写入叶子块buffer中，其余槽位置为空闲
+static void
+fill_leaf(uint8_t *buffer, const struct dir_entry *entries, size_t cnt)
+{
+  uint32_t hint = cnt;
+  memset(buffer, 0, BLOCK_SECTOR_SIZE);
+  memcpy(buffer, entries, cnt * sizeof *entries);
+  memcpy(buffer + DX_LEAF_HINT_OFS, &hint, sizeof hint);
+}
+
+// 将一个索引项插入到path所在的索引项数组中path位置之后，数组已满时拆分索引节点块或增加一层索引
+static bool
+dx_insert_index(struct inode *inode, struct dx_path *path, struct dx_entry e)
+{
+  struct dx_array root = root_array();
+  struct dx_array node;
+  struct dx_node *new_node;
+  struct dx_entry up;
+  uint32_t cnt, half, i;
+  bool success = false;
+
+  if (read_word(inode, offsetof(struct dx_root, levels)) == 0)
+  {
+    if (read_word(inode, root.cnt_ofs) < DX_ROOT_CNT)
+      return array_insert(inode, &root, path->root_pos + 1, e);
+
+    // 根索引块已满，将其中的索引项移入新的索引节点块，根索引块中只保留指向该块的索引项
+    new_node = calloc(1, sizeof *new_node);
+    if (new_node == NULL)
+      return false;
+    new_node->magic = DX_NODE_MAGIC;
+    new_node->cnt = DX_ROOT_CNT;
+    inode_read_at(inode, new_node->entries, DX_ROOT_CNT * sizeof(struct dx_entry), root.entries_ofs);
+    up.hash = 0;
+    up.block = append_block(inode, new_node);
+    free(new_node);
+    if (up.block == 0 ||
+        inode_write_at(inode, &up, sizeof up, root.entries_ofs) != sizeof up ||
+        !write_word(inode, root.cnt_ofs, 1) ||
+        !write_word(inode, offsetof(struct dx_root, levels), 1))
+      return false;
+    path->node = up.block;
+    path->node_pos = path->root_pos;
+    path->root_pos = 0;
+  }
+
+  node = node_array(path->node);
+  cnt = read_word(inode, node.cnt_ofs);
+  if (cnt < DX_NODE_CNT)
+    return array_insert(inode, &node, path->node_pos + 1, e);
+
+  // 索引节点块已满，将后一半索引项移入新的索引节点块并在根索引块中为其添加索引项
+  if (read_word(inode, root.cnt_ofs) >= DX_ROOT_CNT)
+    return false;
+  new_node = calloc(1, sizeof *new_node);
+  if (new_node == NULL)
+    return false;
+  half = cnt / 2;
+  new_node->magic = DX_NODE_MAGIC;
+  new_node->cnt = cnt - half;
+  for (i = half; i < cnt; i++)
+    new_node->entries[i - half] = array_get(inode, &node, i);
+  up.hash = new_node->entries[0].hash;
+  up.block = append_block(inode, new_node);
+  free(new_node);
+  if (up.block == 0 || !write_word(inode, node.cnt_ofs, half) ||
+      !array_insert(inode, &root, path->root_pos + 1, up))
+    return false;
+
+  if (path->node_pos + 1 >= half)
+  {
+    struct dx_array upper = node_array(up.block);
+    success = array_insert(inode, &upper, path->node_pos + 1 - half, e);
+  }
+  else
+    success = array_insert(inode, &node, path->node_pos + 1, e);
+  return success;
+}
+
+// 拆分已满的叶子块path->leaf：按哈希值排序后将后一半目录项移入新的叶子块，哈希值相同的目录项不会被分开
+static bool
+dx_split_leaf(struct inode *inode, struct dx_path *path)
+{
+  struct dir_entry *entries = malloc(DX_LEAF_SLOTS * sizeof *entries);
+  uint8_t *buffer = malloc(BLOCK_SECTOR_SIZE);
+  struct dx_entry e;
+  size_t mid, lo, hi;
+  bool success = false;
+
+  if (entries == NULL || buffer == NULL)
+    goto done;
+  inode_read_at(inode, entries, DX_LEAF_SLOTS * sizeof *entries, slot_ofs(path->leaf, 0));
+  sort_entries(entries, DX_LEAF_SLOTS);
+
+  // 从中间向两侧寻找哈希值发生变化的位置作为拆分点
+  for (lo = hi = DX_LEAF_SLOTS / 2;; lo--, hi++)
+  {
+    if (hi < DX_LEAF_SLOTS && entry_hash(&entries[hi]) != entry_hash(&entries[hi - 1]))
+    {
+      mid = hi;
+      break;
+    }
+    if (lo > 0 && entry_hash(&entries[lo]) != entry_hash(&entries[lo - 1]))
+    {
+      mid = lo;
+      break;
+    }
+    if (lo <= 1 && hi >= DX_LEAF_SLOTS - 1)
+      goto done;
+  }
+
+  // 原叶子块在索引项插入成功之后才改写，插入失败时所有目录项仍在原叶子块中
+  // 新叶子块没有索引项指向它，但遍历目录时仍会扫描到，因此清空其中的目录项
+  fill_leaf(buffer, entries + mid, DX_LEAF_SLOTS - mid);
+  e.hash = entry_hash(&entries[mid]);
+  e.block = append_block(inode, buffer);
+  if (e.block == 0)
+    goto done;
+  if (!dx_insert_index(inode, path, e))
+  {
+    fill_leaf(buffer, NULL, 0);
+    inode_write_at(inode, buffer, BLOCK_SECTOR_SIZE, slot_ofs(e.block, 0));
+    goto done;
+  }
+  fill_leaf(buffer, entries, mid);
+  success = inode_write_at(inode, buffer, BLOCK_SECTOR_SIZE, slot_ofs(path->leaf, 0)) == BLOCK_SECTOR_SIZE;
+
+done:
+  free(entries);
+  free(buffer);
+  return success;
+}
+
+// 将超过一块的线性目录转换为哈希格式，目录项按哈希值排序后写入若干半满的叶子块
+// 叶子块数量超过根索引块的容量或内存不足时保持线性格式并返回false
+static bool
+dx_convert(struct inode *inode)
+{
+  size_t slot_cnt = inode_length(inode) / sizeof(struct dir_entry);
+  struct dir_entry *entries = malloc(slot_cnt * sizeof *entries + 1);
+  struct dx_root *root = calloc(1, sizeof *root);
+  uint8_t *buffer = malloc(BLOCK_SECTOR_SIZE);
+  size_t starts[DX_ROOT_CNT + 1];
+  struct dir_entry e;
+  size_t cnt = 0, fill, leaf_cnt, i;
+  off_t pos = 0, ofs, length;
+  bool success = false;
+
+  if (entries == NULL || root == NULL || buffer == NULL)
+    goto done;
+  while (cnt < slot_cnt && next_entry(inode, &pos, &e))
+    entries[cnt++] = e;
+  sort_entries(entries, cnt);
+
+  // 先尝试让每个叶子块半满以留出插入的空间，叶子块过多时填满每个叶子块
+  for (fill = DX_LEAF_SLOTS / 2;; fill = DX_LEAF_SLOTS)
+  {
+    leaf_cnt = 0;
+    starts[0] = 0;
+    while (leaf_cnt < DX_ROOT_CNT && (starts[leaf_cnt] < cnt || leaf_cnt == 0))
+    {
+      size_t first = starts[leaf_cnt];
+      size_t last = first + fill < cnt ? first + fill : cnt;
+      while (last < cnt && last > first && entry_hash(&entries[last]) == entry_hash(&entries[last - 1]))
+        last++;
+      if (last - first > DX_LEAF_SLOTS)
+        break;
+      starts[++leaf_cnt] = last;
+    }
+    if (leaf_cnt > 0 && starts[leaf_cnt] == cnt)
+      break;
+    if (fill == DX_LEAF_SLOTS)
+      goto done;
+  }
+
+  root->magic = DX_ROOT_MAGIC;
+  root->levels = 0;
+  root->cnt = leaf_cnt;
+  for (i = 0; i < leaf_cnt; i++)
+  {
+    root->entries[i].hash = i == 0 ? 0 : entry_hash(&entries[starts[i]]);
+    root->entries[i].block = i + 1;
+  }
+
+  // 原来的目录项都已经读入内存，先写叶子块再写根索引块
+  for (i = 0; i < leaf_cnt; i++)
+  {
+    fill_leaf(buffer, entries + starts[i], starts[i + 1] - starts[i]);
+    if (inode_write_at(inode, buffer, BLOCK_SECTOR_SIZE, (i + 1) * BLOCK_SECTOR_SIZE) != BLOCK_SECTOR_SIZE)
+      goto done;
+  }
+  if (inode_write_at(inode, root, BLOCK_SECTOR_SIZE, 0) != BLOCK_SECTOR_SIZE)
+    goto done;
+
+  // 清空原来的线性目录中剩余的部分，使其成为没有目录项的块
+  memset(buffer, 0, BLOCK_SECTOR_SIZE);
+  length = inode_length(inode);
+  for (ofs = (leaf_cnt + 1) * BLOCK_SECTOR_SIZE; ofs < length; ofs += BLOCK_SECTOR_SIZE)
+  {
+    off_t size = length - ofs < BLOCK_SECTOR_SIZE ? length - ofs : BLOCK_SECTOR_SIZE;
+    if (inode_write_at(inode, buffer, size, ofs) != size)
+      goto done;
+  }
+  success = true;
+
+done:
+  free(entries);
+  free(root);
+  free(buffer);
+  return success;
+}
+
+// 向哈希目录中添加目录项e：从名称所在叶子块的空闲槽位提示处开始寻找空闲槽位，叶子块已满时拆分后重试
+static bool
+dx_add(struct inode *inode, const struct dir_entry *e)
+{
+  uint32_t hash = name_hash(e->name);
+
+  for (;;)
+  {
+    struct dx_path path;
+    struct dir_entry cur;
+    off_t hint_ofs;
+    uint32_t slot;
+
+    dx_find(inode, hash, &path);
+    hint_ofs = slot_ofs(path.leaf, 0) + DX_LEAF_HINT_OFS;
+    for (slot = read_word(inode, hint_ofs); slot < DX_LEAF_SLOTS; slot++)
+      if (inode_read_at(inode, &cur, sizeof cur, slot_ofs(path.leaf, slot)) != sizeof cur || !cur.in_use)
+        break;
+
+    if (slot < DX_LEAF_SLOTS)
+      return inode_write_at(inode, e, sizeof *e, slot_ofs(path.leaf, slot)) == sizeof *e &&
+             write_word(inode, hint_ofs, slot + 1);
+    if (!dx_split_leaf(inode, &path))
+      return false;
+  }
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
-// 进行inode的操作前后加锁
+// 查找期间共享持有目录的锁，多个线程可以同时在同一目录中查找
+// 先查找目录项缓存，未命中时扫描目录并将结果（包括不存在的名称）加入缓存
 bool dir_lookup(const struct dir *dir, const char *name, struct inode **inode)
 {
   struct dir_entry e;
+  block_sector_t parent, sector;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
-  inode_lock(dir_get_inode((struct dir *)dir));
-  if (lookup(dir, name, &e, NULL))
-    *inode = inode_open(e.inode_sector);
-  else
-    *inode = NULL;
-  inode_unlock(dir_get_inode((struct dir *)dir));
+  parent = inode_get_inumber(dir->inode);
+  inode_lock_shared(dir_get_inode((struct dir *)dir));
+  if (!dcache_get(parent, name, &sector))
+  {
+    sector = lookup(dir, name, &e, NULL) ? e.inode_sector : 0;
+    dcache_put(parent, name, sector);
+  }
+  *inode = sector != 0 ? inode_open(sector) : NULL;
+  inode_unlock_shared(dir_get_inode((struct dir *)dir));
   return *inode != NULL;
 }
 
@@ -139,7 +780,7 @@ bool dir_lookup(const struct dir *dir, const char *name, struct inode **inode)
 // 添加父子文件的设置以及为inode的操作加锁
 bool dir_add(struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-  struct dir_entry e;
+  struct dir_entry e, new;
   off_t ofs;
   bool success = false;
 
@@ -157,6 +798,19 @@ bool dir_add(struct dir *dir, const char *name, block_sector_t inode_sector)
   // 将传入的扇区作为dir目录的子文件
   if (!inode_set_parent(inode_get_inumber(dir_get_inode(dir)), inode_sector))
     goto done;
+  /* Fill in the new entry. */
+  memset(&new, 0, sizeof new);
+  new.in_use = true;
+  strlcpy(new.name, name, sizeof new.name);
+  new.inode_sector = inode_sector;
+
+  // 哈希目录直接在名称所在的叶子块中插入
+  if (is_hashed(dir->inode))
+  {
+    success = dx_add(dir->inode, &new);
+    goto done;
+  }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -169,13 +823,20 @@ bool dir_add(struct dir *dir, const char *name, block_sector_t inode_sector)
     if (!e.in_use)
       break;
 
+  // 线性目录没有空闲槽位且将要超过一块时转换为哈希格式，转换失败时继续使用线性格式
+  if (ofs >= inode_length(dir->inode) && ofs + sizeof e > BLOCK_SECTOR_SIZE &&
+      dx_convert(dir->inode))
+  {
+    success = dx_add(dir->inode, &new);
+    goto done;
+  }
+
   /* Write slot. */
-  e.in_use = true;
-  strlcpy(e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+  success = inode_write_at(dir->inode, &new, sizeof new, ofs) == sizeof new;
 
 done:
+  if (success)
+    dcache_put(inode_get_inumber(dir->inode), name, inode_sector);
   inode_unlock(dir_get_inode(dir));
   return success;
 }
@@ -188,6 +849,7 @@ bool dir_remove(struct dir *dir, const char *name)
 {
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool child_locked = false;
   bool success = false;
   off_t ofs;
 
@@ -206,6 +868,13 @@ bool dir_remove(struct dir *dir, const char *name)
   if (inode_is_dir(inode) && inode_get_open_cnt(inode) > 1)
     goto done;
 
+  // 删除目录时持有其锁直到删除完成，以免同时向其中添加目录项（先父后子的加锁顺序）
+  if (inode_is_dir(inode))
+  {
+    inode_lock(inode);
+    child_locked = true;
+  }
+
   // 如果当前目录非空
   if (inode_is_dir(inode) && !dir_is_empty(inode))
     goto done;
@@ -215,11 +884,27 @@ bool dir_remove(struct dir *dir, const char *name)
   if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
     goto done;
 
+  // 哈希目录中被释放的槽位之前的槽位都在使用，更新叶子块的空闲槽位提示
+  if (is_hashed(dir->inode))
+  {
+    off_t hint_ofs = slot_ofs(ofs / BLOCK_SECTOR_SIZE, 0) + DX_LEAF_HINT_OFS;
+    uint32_t slot = (ofs % BLOCK_SECTOR_SIZE) / sizeof e;
+    if (slot < read_word(dir->inode, hint_ofs))
+      write_word(dir->inode, hint_ofs, slot);
+  }
+
+  // 名称记录为否定项，被删除的目录下的缓存项全部作废
+  dcache_put(inode_get_inumber(dir->inode), name, 0);
+  if (inode_is_dir(inode))
+    dcache_purge(e.inode_sector);
+
   /* Remove inode. */
   inode_remove(inode);
   success = true;
 
 done:
+  if (child_locked)
+    inode_unlock(inode);
   inode_close(inode);
   inode_unlock(dir_get_inode(dir));
   return success;
@@ -228,22 +913,18 @@ done:
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
-// 给inode操作加锁
+// 读取期间共享持有目录的锁
 bool dir_readdir(struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
-  inode_lock(dir_get_inode(dir));
-  while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e)
+  inode_lock_shared(dir_get_inode(dir));
+  if (next_entry(dir->inode, &dir->pos, &e))
   {
-    dir->pos += sizeof e;
-    if (e.in_use)
-    {
-      strlcpy(name, e.name, NAME_MAX + 1);
-      inode_unlock(dir_get_inode(dir));
-      return true;
-    }
+    strlcpy(name, e.name, NAME_MAX + 1);
+    inode_unlock_shared(dir_get_inode(dir));
+    return true;
   }
-  inode_unlock(dir_get_inode(dir));
+  inode_unlock_shared(dir_get_inode(dir));
   return false;
 }
 
@@ -270,13 +951,5 @@ bool dir_is_empty(struct inode *inode)
   struct dir_entry e;
   off_t pos = 0;
 
-  while (inode_read_at(inode, &e, sizeof e, pos) == sizeof e)
-  {
-    pos += sizeof e;
-    if (e.in_use)
-    {
-      return false;
-    }
-  }
-  return true;
+  return !next_entry(inode, &pos, &e);
 }
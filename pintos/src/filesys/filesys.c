@@ -7,6 +7,7 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/journal.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
 /* Partition that contains the file system. */
@@ -26,23 +27,32 @@ void filesys_init(bool format)
     PANIC("No file system device found, can't initialize file system.");
   init_cache(); // 初始化缓冲区
   inode_init();
+  dir_init(); // 初始化目录项缓存
 
   free_map_init();
 
   if (format)
     do_format();
 
+  journal_init(); // 重放日志中已经提交的事务，然后开始记录元数据日志
   free_map_open();
-  // 初始化文件系统的访问锁
-  lock_init(&filesys_lock);
 }
 
 /* Shuts down the file system module, writing any unwritten data
    to disk. */
 void filesys_done(void)
 {
+  journal_close();  // 提交最后的事务并清空日志
+  free_map_close(); // 先将空闲扇区位图写入缓冲区
   write_back(true); // 将缓冲区的内容写回到磁盘中
-  free_map_close();
+}
+
+// 模拟在提交日志之后立即断电：写回不属于当前事务的脏块，再将当前事务写入日志，
+// 但不写回事务中的块也不清空日志，下次启动时这些元数据只能由filesys_init重放日志恢复
+void filesys_crash(void)
+{
+  write_back(false);
+  journal_commit();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -54,17 +64,20 @@ void filesys_done(void)
 bool filesys_create(const char *name, off_t initial_size, bool is_dir)
 {
   block_sector_t inode_sector = 0;
+  journal_start(); // 新的inode和目录项属于同一个事务
   struct dir *dir = path_to_dir(name);  // 获取到name的最底层目录
   char *file_name = path_to_name(name); // 获取到name指定的文件名
   bool success = false;
   // 如果文件名不为.或者..那么就分配扇区、创建inode同时将该扇区添加到dir目录下
   if (strcmp(file_name, ".") != 0 && strcmp(file_name, "..") != 0)
   {
-    success = (dir != NULL && free_map_allocate(1, &inode_sector) && inode_create(inode_sector, initial_size, is_dir) && dir_add(dir, file_name, inode_sector));
+    // 新的inode尽量分配在其父目录的inode附近
+    success = (dir != NULL && free_map_allocate_near(1, inode_get_inumber(dir_get_inode(dir)), &inode_sector) && inode_create(inode_sector, initial_size, is_dir) && dir_add(dir, file_name, inode_sector));
   }
   if (!success && inode_sector != 0)
     free_map_release(inode_sector, 1);
   dir_close(dir);
+  journal_stop();
   free(file_name);
   return success;
 }
@@ -122,10 +135,12 @@ filesys_open(const char *name)
 // 修改为父子目录条件下文件的删除
 bool filesys_remove(const char *name)
 {
+  journal_start(); // 删除目录项和释放inode属于同一个事务
   struct dir *dir = path_to_dir(name);  // 获取到name的最底层目录
   char *file_name = path_to_name(name); // 获取到name指定的文件名
   bool success = dir != NULL && dir_remove(dir, file_name);
   dir_close(dir);
+  journal_stop();
   free(file_name);
   return success;
 }
@@ -135,6 +150,7 @@ static void
 do_format(void)
 {
   printf("Formatting file system...");
+  journal_create(); // 日志区域必须在空闲扇区位图文件分配数据块之前预留
   free_map_create();
   if (!dir_create(ROOT_DIR_SECTOR, 16))
     PANIC("root directory creation failed");
@@ -3,18 +3,16 @@
 
 #include <stdbool.h>
 #include "filesys/off_t.h"
-#include "threads/synch.h"
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0 /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1 /* Root directory file inode sector. */
 
 /* Block device that contains the file system. */
 extern struct block *fs_device;
-// 对文件系统加锁
-struct lock filesys_lock;
 
 void filesys_init(bool format);
 void filesys_done(void);
+void filesys_crash(void);
 bool filesys_create(const char *name, off_t initial_size, bool is_dir);
 struct file *filesys_open(const char *name);
 bool filesys_remove(const char *name);
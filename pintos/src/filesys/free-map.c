@@ -1,12 +1,78 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+
+/* Number of free map bits stored in one sector of the free map
+   file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* Number of sectors in an allocation group.  The disk is divided
+   into groups of this many sectors, and free_map_allocate_near()
+   stays within the group of its goal sector when it can. */
+#define ALLOC_GROUP_SECTORS 1024
 
 static struct file *free_map_file; /* Free map file. */
 static struct bitmap *free_map;    /* Free map, one bit per sector. */
+static struct bitmap *dirty_map;   /* Free map file sectors not yet written. */
+static size_t free_map_cursor;     /* Where the next search starts. */
+static struct lock free_map_lock;  /* Protects the members above and below. */
+
+/* Sectors released while the journal is enabled stay marked in
+   FREE_MAP, so they cannot be allocated, until no committed
+   transaction in the journal can still be replayed over them.
+   A sector moves from FREED_MAP (released in the running
+   transaction) to COMMIT_MAP (released in the transaction being
+   written to the journal) to LOGGED_MAP (released in the
+   transaction now held in the journal), and becomes allocatable
+   once the next transaction has replaced it in the journal.  The
+   free map file always shows these sectors as free. */
+static bool defer_release;         /* Whether releases are deferred. */
+static struct bitmap *freed_map;   /* Released in the running transaction. */
+static struct bitmap *commit_map;  /* Released in the committing transaction. */
+static struct bitmap *logged_map;  /* Released in the journaled transaction. */
+
+/* Marks the free map file sectors that hold the bits for the CNT
+   sectors starting at SECTOR as needing to be written. */
+static void
+mark_dirty(block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+  if (cnt == 0)
+    return;
+  bitmap_set_multiple(dirty_map, first, last - first + 1, true);
+}
+
+/* Sets or clears, in DST, every bit that is set in SRC. */
+static void
+apply_bits(struct bitmap *dst, const struct bitmap *src, bool value)
+{
+  size_t first = bitmap_scan(src, 0, 1, true);
+  while (first != BITMAP_ERROR)
+  {
+    size_t last = bitmap_scan(src, first, 1, false);
+    if (last == BITMAP_ERROR)
+      last = bitmap_size(src);
+    bitmap_set_multiple(dst, first, last - first, value);
+    first = last < bitmap_size(src) ? bitmap_scan(src, last, 1, true) : BITMAP_ERROR;
+  }
+}
+
+/* Sets or clears, in FREE_MAP, the bits of every sector whose
+   release is deferred. */
+static void
+apply_deferred(bool value)
+{
+  apply_bits(free_map, freed_map, value);
+  apply_bits(free_map, commit_map, value);
+  apply_bits(free_map, logged_map, value);
+}
 
 /* Initializes the free map. */
 void free_map_init(void)
@@ -14,34 +80,178 @@ void free_map_init(void)
   free_map = bitmap_create(block_size(fs_device));
   if (free_map == NULL)
     PANIC("bitmap creation failed--file system device is too large");
+  dirty_map = bitmap_create(DIV_ROUND_UP(bitmap_size(free_map), BITS_PER_SECTOR));
+  if (dirty_map == NULL)
+    PANIC("bitmap creation failed--file system device is too large");
+  freed_map = bitmap_create(bitmap_size(free_map));
+  commit_map = bitmap_create(bitmap_size(free_map));
+  logged_map = bitmap_create(bitmap_size(free_map));
+  if (freed_map == NULL || commit_map == NULL || logged_map == NULL)
+    PANIC("bitmap creation failed--file system device is too large");
+  lock_init(&free_map_lock);
   bitmap_mark(free_map, FREE_MAP_SECTOR);
   bitmap_mark(free_map, ROOT_DIR_SECTOR);
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the free map, searching
+   in next-fit order, and stores the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.
+   Only the in-memory free map is changed; the affected sectors of
+   the free map file are written by the next free_map_flush(). */
 bool free_map_allocate(size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR && free_map_file != NULL && !bitmap_write(free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire(&free_map_lock);
+  sector = bitmap_scan_and_flip_next(free_map, &free_map_cursor, cnt, false);
+  if (sector != BITMAP_ERROR)
   {
-    bitmap_set_multiple(free_map, sector, cnt, false);
-    sector = BITMAP_ERROR;
+    mark_dirty(sector, cnt);
+    *sectorp = sector;
+  }
+  lock_release(&free_map_lock);
+  return sector != BITMAP_ERROR;
+}
+
+/* Allocates CNT consecutive sectors from the free map, placing
+   them as close to sector GOAL as possible, and stores the first
+   into *SECTORP.  Prefers, in order: the run starting exactly at
+   GOAL, the first run after GOAL within GOAL's allocation group,
+   the first run anywhere in that group, and the first run in the
+   following groups, wrapping around at the end of the disk.
+   Returns true if successful, false if not enough consecutive
+   sectors were available. */
+bool free_map_allocate_near(size_t cnt, block_sector_t goal, block_sector_t *sectorp)
+{
+  size_t size = bitmap_size(free_map);
+  size_t group_start, group_end, sector;
+
+  if (goal >= size)
+    goal = 0;
+  group_start = goal - goal % ALLOC_GROUP_SECTORS;
+  group_end = group_start + ALLOC_GROUP_SECTORS < size ? group_start + ALLOC_GROUP_SECTORS : size;
+
+  lock_acquire(&free_map_lock);
+  if (cnt <= size - goal && !bitmap_contains(free_map, goal, cnt, true))
+    sector = goal;
+  else
+  {
+    sector = bitmap_scan(free_map, goal, cnt, false);
+    if (sector == BITMAP_ERROR || sector + cnt > group_end)
+      sector = bitmap_scan(free_map, group_start, cnt, false);
+    if (sector == BITMAP_ERROR || sector + cnt > group_end)
+    {
+      size_t cursor = group_end;
+      sector = bitmap_scan_next(free_map, &cursor, cnt, false);
+    }
   }
   if (sector != BITMAP_ERROR)
+  {
+    bitmap_set_multiple(free_map, sector, cnt, true);
+    mark_dirty(sector, cnt);
     *sectorp = sector;
+  }
+  lock_release(&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use.
+   While the journal is enabled the sectors are only marked free in
+   the free map file; they become available for allocation after
+   free_map_committed() has been called twice more (see above). */
 void free_map_release(block_sector_t sector, size_t cnt)
 {
+  lock_acquire(&free_map_lock);
   ASSERT(bitmap_all(free_map, sector, cnt));
-  bitmap_set_multiple(free_map, sector, cnt, false);
-  bitmap_write(free_map, free_map_file);
+  if (defer_release)
+  {
+    ASSERT(bitmap_none(freed_map, sector, cnt));
+    bitmap_set_multiple(freed_map, sector, cnt, true);
+  }
+  else
+    bitmap_set_multiple(free_map, sector, cnt, false);
+  mark_dirty(sector, cnt);
+  lock_release(&free_map_lock);
+}
+
+/* Starts or stops deferring releases.  When stopping, the journal
+   has been emptied, so every deferred sector becomes available. */
+void free_map_defer_release(bool defer)
+{
+  lock_acquire(&free_map_lock);
+  if (!defer)
+  {
+    apply_deferred(false);
+    bitmap_set_all(freed_map, false);
+    bitmap_set_all(commit_map, false);
+    bitmap_set_all(logged_map, false);
+  }
+  defer_release = defer;
+  lock_release(&free_map_lock);
+}
+
+/* Called when the running transaction is closed for commit: the
+   sectors released in it now belong to the committing
+   transaction. */
+void free_map_commit(void)
+{
+  lock_acquire(&free_map_lock);
+  apply_bits(commit_map, freed_map, true);
+  bitmap_set_all(freed_map, false);
+  lock_release(&free_map_lock);
+}
+
+/* Called once the committing transaction has been written to the
+   journal and replaces the previous one there.  Sectors released
+   in the previous transaction can no longer be overwritten by a
+   replay and become available. */
+void free_map_committed(void)
+{
+  lock_acquire(&free_map_lock);
+  apply_bits(free_map, logged_map, false);
+  bitmap_set_all(logged_map, false);
+  apply_bits(logged_map, commit_map, true);
+  bitmap_set_all(commit_map, false);
+  lock_release(&free_map_lock);
+}
+
+/* Writes the sectors of the free map file whose bits changed
+   since the last flush.  Each run of adjacent dirty sectors is
+   written with a single call, into the buffer cache, as part of
+   the journal's running transaction. */
+void free_map_flush(void)
+{
+  size_t first, last;
+
+  if (free_map_file == NULL)
+    return;
+
+  journal_start();
+  lock_acquire(&free_map_lock);
+  /* Deferred sectors are written as free. */
+  apply_deferred(false);
+  first = bitmap_scan(dirty_map, 0, 1, true);
+  while (first != BITMAP_ERROR)
+  {
+    size_t start = first * BITS_PER_SECTOR;
+    size_t end;
+
+    last = bitmap_scan(dirty_map, first, 1, false);
+    if (last == BITMAP_ERROR)
+      last = bitmap_size(dirty_map);
+    end = last * BITS_PER_SECTOR;
+    if (end > bitmap_size(free_map))
+      end = bitmap_size(free_map);
+
+    bitmap_set_multiple(dirty_map, first, last - first, false);
+    if (!bitmap_write_range(free_map, free_map_file, start, end - start))
+      PANIC("can't write free map");
+    first = bitmap_scan(dirty_map, last, 1, true);
+  }
+  apply_deferred(true);
+  lock_release(&free_map_lock);
+  journal_stop();
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -57,6 +267,7 @@ void free_map_open(void)
 /* Writes the free map to disk and closes the free map file. */
 void free_map_close(void)
 {
+  free_map_flush();
   file_close(free_map_file);
 }
 
@@ -75,4 +286,5 @@ void free_map_create(void)
     PANIC("can't open free map");
   if (!bitmap_write(free_map, free_map_file))
     PANIC("can't write free map");
+  bitmap_set_all(dirty_map, false);
 }
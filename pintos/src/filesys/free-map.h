@@ -10,8 +10,13 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_flush (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_near (size_t, block_sector_t goal, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_defer_release (bool);
+void free_map_commit (void);
+void free_map_committed (void);
 
 #endif /* filesys/free-map.h */
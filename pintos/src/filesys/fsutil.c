@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +12,10 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Number of sectors fsutil_extract() reads from the scratch
+   device with each request. */
+#define EXTRACT_CHUNK_SECTORS 16
+
 /* List files in the root directory. */
 void fsutil_ls(char **argv UNUSED)
 {
@@ -76,7 +81,7 @@ void fsutil_extract(char **argv UNUSED)
 
   /* Allocate buffers. */
   header = malloc(BLOCK_SECTOR_SIZE);
-  data = malloc(BLOCK_SECTOR_SIZE);
+  data = malloc(EXTRACT_CHUNK_SECTORS * BLOCK_SECTOR_SIZE);
   if (header == NULL || data == NULL)
     PANIC("couldn't allocate buffers");
 
@@ -121,13 +126,16 @@ void fsutil_extract(char **argv UNUSED)
       if (dst == NULL)
         PANIC("%s: open failed", file_name);
 
-      /* Do copy. */
+      /* Do copy, reading up to EXTRACT_CHUNK_SECTORS sectors
+         with each request. */
       while (size > 0)
       {
-        int chunk_size = (size > BLOCK_SECTOR_SIZE
-                              ? BLOCK_SECTOR_SIZE
+        int chunk_size = (size > EXTRACT_CHUNK_SECTORS * BLOCK_SECTOR_SIZE
+                              ? EXTRACT_CHUNK_SECTORS * BLOCK_SECTOR_SIZE
                               : size);
-        block_read(src, sector++, data);
+        size_t chunk_sectors = DIV_ROUND_UP(chunk_size, BLOCK_SECTOR_SIZE);
+        block_read_multiple(src, sector, chunk_sectors, data);
+        sector += chunk_sectors;
         if (file_write(dst, data, chunk_size) != chunk_size)
           PANIC("%s: write failed with %d bytes unwritten",
                 file_name, size);
@@ -1,5 +1,6 @@
 #include "filesys/inode.h"
 #include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 #include "filesys/cache.h"
+#include "filesys/journal.h"
 #include "threads/synch.h"
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -19,13 +21,52 @@
 #define DOUBLE_DIRECT_BLOCKS 1 // 二级索引
 #define INODE_PTRS 14          // 每个文件的索引数组总长度为14由4个直接索引+9个一级索引+1个二级索引组成
 
+#define READ_AHEAD_MAX 32 // 预读窗口的最大逻辑块数
+#define INODE_CLOSED_MAX 64 // 保留在内存中的最近关闭的inode的最大数量
+
+// inode的数据块组织格式，旧的inode的对应字段为0因此使用多级索引格式
+#define INODE_INDEXED 0 // 直接索引+一级索引+二级索引
+#define INODE_EXTENTS 1 // 区段(extent)格式
+#define INODE_INLINE 2  // 内联格式，文件的内容直接存放在inode扇区中区段数组的位置
+
+#define INODE_EXTENTS_CNT 34 // inode扇区中区段数组的长度
+#define EXTENT_NODE_CNT 42   // 每个区段树节点扇区中区段数组的长度
+#define EXTENT_MAX_DEPTH 2   // 区段树除inode中的根以外的最大层数
+#define EXTENT_MAX_CNT 0xffff // 一个区段最多包含的扇区数量
+#define INODE_INLINE_MAX ((off_t)(INODE_EXTENTS_CNT * sizeof(struct extent))) // 内联格式的文件的最大长度，即区段数组的字节数
+
+// 区段：文件中从逻辑块block开始的cnt个块连续存放在从start开始的扇区中
+// 只有前init个块写入过数据，其余的块类似ext4的未写入区段，读出全0且不访问磁盘
+// 在区段树的内部节点中start为子节点所在扇区，cnt和init不使用
+struct extent
+{
+  uint32_t block;       // 区段的第一个逻辑块号
+  block_sector_t start; // 区段的第一个扇区编号或子节点的扇区编号
+  uint16_t cnt;         // 区段包含的扇区数量
+  uint16_t init;        // 区段开头已经写入过数据的块数
+};
+
+// 区段树节点，占据一个扇区，区段按逻辑块号升序排列
+struct extent_node
+{
+  uint32_t cnt;                            // 节点中区段的数量
+  uint32_t unused;                         // 未使用
+  struct extent entries[EXTENT_NODE_CNT]; // 区段数组
+};
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+// 内联格式的inode不占用数据扇区，extents的字节直接存放文件的内容，长度超过INODE_INLINE_MAX时转为区段格式
 struct inode_disk
 {
   off_t length;         /* File size in bytes. */
   unsigned magic;       /* Magic number. */
-  uint32_t unused[107]; /* Not used. */
+
+  uint32_t format;                            // 数据块组织格式
+  uint32_t extent_depth;                      // 区段树除根以外的层数，为0时extents就是叶子
+  uint32_t extent_cnt;                        // extents中区段的数量
+  struct extent extents[INODE_EXTENTS_CNT];   // 区段树的根
+  uint32_t unused[2];                         /* Not used. */
 
   uint32_t direct_index;          // 直接索引
   uint32_t indirect_index;        // 一级索引
@@ -46,11 +87,14 @@ bytes_to_sectors(off_t size)
 /* In-memory inode. */
 struct inode
 {
-  struct list_elem elem; /* Element in inode list. */
+  struct hash_elem elem;        /* Element in open_inodes. */
+  struct list_elem closed_elem; // 打开者数量为0时在closed_inodes中的元素
   block_sector_t sector; /* Sector number of disk location. */
   int open_cnt;          /* Number of openers. */
   bool removed;          /* True if deleted, false otherwise. */
   int deny_write_cnt;    /* 0: writes ok, >0: deny writes. */
+  bool dirty;            // 长度、块映射、格式或父目录被修改过，最后一次关闭时需要写回inode扇区
+  bool closing;          // 最后一个关闭者正在释放open_inodes_lock写回inode扇区，此时不在closed_inodes中
 
   off_t length;                   // 文件长度
   off_t read_length;              // 文件的可读取长度
@@ -60,72 +104,215 @@ struct inode
   block_sector_t blocks[14];      // 索引数组
   bool is_dir;                    // 是否是目录
   block_sector_t parent;          // 父文件（目录）的扇区编号
-  struct lock lock;               // 文件锁
+  struct rwlock lock;             // 文件锁，目录用它保护目录项，查找目录时共享持有
+  struct rwlock data_lock;        // 保护文件长度、块映射和写入者计数，读取文件时共享持有
+  struct lock memo_lock;          // 共享持有data_lock时保护查找缓存(run、extent_hit)和预读状态
+  struct lock range_lock;         // 保护write_ranges
+  struct list write_ranges;       // 正在进行的原地写入所锁定的字节范围，按起始位置升序排列
+  struct condition range_released; // 有字节范围被解锁
+
+  block_sector_t *run;  // 最近一次解析的索引块中的扇区编号，为NULL时未缓存
+  size_t run_first;     // run[0]对应的文件逻辑块号
+
+  uint32_t format;                          // 数据块组织格式
+  uint32_t extent_depth;                    // 区段树除根以外的层数
+  uint32_t extent_cnt;                      // extents中区段的数量
+  struct extent extents[INODE_EXTENTS_CNT]; // 区段树的根
+  struct extent extent_hit;                 // 最近一次查找命中的叶子区段，cnt为0时无效
+
+  size_t ahead_next;   // 顺序读时下一次读取期望的逻辑块号
+  size_t ahead_window; // 预读窗口大小，顺序读时加倍，随机读时清零
+  size_t ahead_end;    // 已经提交预读的逻辑块号的上界（不含）
 };
 
 // 根据inode_disk的相关信息分配inode空间后将inode和inode_disk的信息同步
-bool inode_alloc(struct inode_disk *inode_disk);
+bool inode_alloc(block_sector_t sector, struct inode_disk *inode_disk);
 // 将指定的inode扩展到length长度
 off_t inode_grow(struct inode *inode, off_t length);
+static void indexed_grow(struct inode *inode, size_t grow_sectors);
 // 释放inode所占据的空间
 void inode_free(struct inode *inode);
 
+// 区段格式的查找、扩展和释放
+static struct extent extent_find(struct inode *inode, size_t block);
+static block_sector_t extent_lookup(struct inode *inode, size_t block);
+static void extent_written(struct inode *inode, size_t block);
+static off_t extent_grow(struct inode *inode, off_t length);
+static void extent_free(struct inode *inode);
+
+// 内联格式的inode中存放文件内容的字节数组，长度之后的字节总是0
+static uint8_t *
+inline_data(struct inode *inode)
+{
+  return (uint8_t *)inode->extents;
+}
+
+// 判断逻辑块block是否已经分配但从未写入，这样的块读出全0且写入前不需要从磁盘读入
+// 调用者持有memo_lock或者独占data_lock
+static bool
+block_unwritten(struct inode *inode, size_t block)
+{
+  struct extent e;
+
+  if (inode->format != INODE_EXTENTS)
+    return false;
+  e = extent_find(inode, block);
+  return block - e.block >= e.init;
+}
+
+// 读取索引块index_sector中的第i个扇区编号，索引块在读取期间固定在Cache中
+static block_sector_t
+read_index(block_sector_t index_sector, size_t i)
+{
+  int cache_idx = access_cache_entry(index_sector);
+  block_sector_t sector = ((block_sector_t *)cache_array[cache_idx].block)[i];
+  release_cache_entry(cache_idx, false);
+  return sector;
+}
+
+// 将一级索引块index_sector的内容记录到inode中，first为其覆盖的第一个逻辑块号
+static bool
+load_run(struct inode *inode, block_sector_t index_sector, size_t first)
+{
+  if (inode->run == NULL)
+  {
+    inode->run = malloc(INDIRECT_PTRS * sizeof(block_sector_t));
+    if (inode->run == NULL)
+      return false;
+  }
+  cache_read(index_sector, inode->run);
+  inode->run_first = first;
+  return true;
+}
+
+// 索引块被修改后使inode中记录的扇区编号失效
+static void
+invalidate_run(struct inode *inode)
+{
+  free(inode->run);
+  inode->run = NULL;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 // 获取length长度的inode文件pos位置所处在的物理块扇区编号
+// 索引块通过Cache读取，同时记住最近一次用到的一级索引块，顺序读写时不需要重复读取索引块
 static block_sector_t
-byte_to_sector(const struct inode *inode, off_t length, off_t pos)
+byte_to_sector(struct inode *inode, off_t length, off_t pos)
 {
   ASSERT(inode != NULL);
   if (pos < length)
   {
-    uint32_t idx;
-    uint32_t blocks[INDIRECT_PTRS];
+    size_t block = pos / BLOCK_SECTOR_SIZE; // 文件的逻辑块号
+    size_t first, idx;
+    block_sector_t index_sector;
+
+    if (inode->format == INODE_EXTENTS)
+      return extent_lookup(inode, block);
 
     // 直接索引能直接寻址
-    if (pos < DIRECT_BLOCKS * BLOCK_SECTOR_SIZE)
-    {
-      return inode->blocks[pos / BLOCK_SECTOR_SIZE];
-    }
+    if (block < DIRECT_BLOCKS)
+      return inode->blocks[block];
 
-    // 一级索引需要先将直接寻址获取到的物理块赋值给blocks数组后进行二次寻址
-    else if (pos < (DIRECT_BLOCKS + INDIRECT_BLOCKS * INDIRECT_PTRS) * BLOCK_SECTOR_SIZE)
-    {
-      pos -= DIRECT_BLOCKS * BLOCK_SECTOR_SIZE;
-      idx = pos / (INDIRECT_PTRS * BLOCK_SECTOR_SIZE) + DIRECT_BLOCKS;
-      block_read(fs_device, inode->blocks[idx], &blocks);
+    // 逻辑块落在最近一次解析的索引块中
+    if (inode->run != NULL && block >= inode->run_first &&
+        block < inode->run_first + INDIRECT_PTRS)
+      return inode->run[block - inode->run_first];
 
-      pos %= INDIRECT_PTRS * BLOCK_SECTOR_SIZE;
-      return blocks[pos / BLOCK_SECTOR_SIZE];
+    // 一级索引直接从inode中获取索引块
+    if (block < DIRECT_BLOCKS + INDIRECT_BLOCKS * INDIRECT_PTRS)
+    {
+      idx = (block - DIRECT_BLOCKS) / INDIRECT_PTRS;
+      first = DIRECT_BLOCKS + idx * INDIRECT_PTRS;
+      index_sector = inode->blocks[DIRECT_BLOCKS + idx];
     }
 
-    // 二级索引需要先将直接寻址获取到的物理块赋值给blocks数组后再通过偏移量二次寻址后将该物理块再赋值给blocks数组进行三次寻址
+    // 二级索引需要先从二级索引块中获取一级索引块
     else
     {
-      block_read(fs_device, inode->blocks[INODE_PTRS - 1], &blocks);
-
-      pos -= (DIRECT_BLOCKS + INDIRECT_BLOCKS * INDIRECT_PTRS) * BLOCK_SECTOR_SIZE;
-      idx = pos / (INDIRECT_PTRS * BLOCK_SECTOR_SIZE);
-      block_read(fs_device, blocks[idx], &blocks);
-
-      pos %= INDIRECT_PTRS * BLOCK_SECTOR_SIZE;
-      return blocks[pos / BLOCK_SECTOR_SIZE];
+      size_t base = DIRECT_BLOCKS + INDIRECT_BLOCKS * INDIRECT_PTRS;
+      idx = (block - base) / INDIRECT_PTRS;
+      first = base + idx * INDIRECT_PTRS;
+      index_sector = read_index(inode->blocks[INODE_PTRS - 1], idx);
     }
+
+    if (load_run(inode, index_sector, first))
+      return inode->run[block - first];
+    return read_index(index_sector, block - first);
   }
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
+/* Table of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+// 以扇区号为键的哈希表，也包含closed_inodes中打开者数量为0的inode
+static struct hash open_inodes;
+
+// 最近关闭的inode，最近关闭的在前，再次打开时不需要重新读取inode_disk
+static struct list closed_inodes;
+static size_t closed_cnt; // closed_inodes中inode的数量
+static struct inode inode_key; // 查找open_inodes时使用的键
+static struct lock open_inodes_lock; // 保护以上成员以及每个inode的open_cnt
+
+// 以inode的扇区号作为哈希值
+static unsigned
+inode_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int(hash_entry(e, struct inode, elem)->sector);
+}
+
+// 按照扇区号比较两个inode
+static bool
+inode_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
+{
+  return hash_entry(a, struct inode, elem)->sector < hash_entry(b, struct inode, elem)->sector;
+}
+
+// 在open_inodes中查找扇区sector对应的inode，不存在时返回NULL，调用者需持有open_inodes_lock
+static struct inode *
+find_inode(block_sector_t sector)
+{
+  struct hash_elem *e;
+
+  inode_key.sector = sector;
+  e = hash_find(&open_inodes, &inode_key.elem);
+  return e != NULL ? hash_entry(e, struct inode, elem) : NULL;
+}
+
+// 释放一个已经关闭的inode占用的内存，其内容在关闭时已经写回，调用者需持有open_inodes_lock
+static void
+drop_closed(struct inode *inode)
+{
+  ASSERT(inode->open_cnt == 0);
+  hash_delete(&open_inodes, &inode->elem);
+  list_remove(&inode->closed_elem);
+  closed_cnt--;
+  free(inode->run);
+  free(inode);
+}
+
+// 增加一个打开者，最近关闭的inode从closed_inodes中取回，调用者需持有open_inodes_lock
+static void
+grab_inode(struct inode *inode)
+{
+  if (inode->open_cnt == 0 && !inode->closing)
+  {
+    list_remove(&inode->closed_elem);
+    closed_cnt--;
+  }
+  inode->open_cnt++;
+}
 
 /* Initializes the inode module. */
 void inode_init(void)
 {
-  list_init(&open_inodes);
+  lock_init(&open_inodes_lock);
+  hash_init(&open_inodes, inode_hash, inode_less, NULL);
+  list_init(&closed_inodes);
+  closed_cnt = 0;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -145,6 +332,13 @@ bool inode_create(block_sector_t sector, off_t length, bool is_dir)
      one sector in size, and you should fix that. */
   ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  // 扇区可能之前属于一个创建失败后被释放的inode，丢弃其在内存中残留的副本
+  lock_acquire(&open_inodes_lock);
+  struct inode *stale = find_inode(sector);
+  if (stale != NULL && stale->open_cnt == 0 && !stale->closing)
+    drop_closed(stale);
+  lock_release(&open_inodes_lock);
+
   disk_inode = calloc(1, sizeof *disk_inode);
   if (disk_inode != NULL)
   {
@@ -152,10 +346,12 @@ bool inode_create(block_sector_t sector, off_t length, bool is_dir)
     disk_inode->magic = INODE_MAGIC;
     disk_inode->is_dir = is_dir;          // 设置是否是目录
     disk_inode->parent = ROOT_DIR_SECTOR; // 设置其父目录为根目录
+    // 新建的inode使用区段格式，足够小的文件和目录使用内联格式
+    disk_inode->format = length <= INODE_INLINE_MAX ? INODE_INLINE : INODE_EXTENTS;
     // 根据disk_inode来生成inode并将inode的属性回调赋值给disk_inode
-    if (inode_alloc(disk_inode))
+    if (inode_alloc(sector, disk_inode))
     {
-      block_write(fs_device, sector, disk_inode);
+      cache_write_meta(sector, disk_inode);
       success = true;
     }
     free(disk_inode);
@@ -169,20 +365,16 @@ bool inode_create(block_sector_t sector, off_t length, bool is_dir)
 struct inode *
 inode_open(block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *other;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin(&open_inodes); e != list_end(&open_inodes);
-       e = list_next(e))
-  {
-    inode = list_entry(e, struct inode, elem);
-    if (inode->sector == sector)
-    {
-      inode_reopen(inode);
-      return inode;
-    }
-  }
+  lock_acquire(&open_inodes_lock);
+  inode = find_inode(sector);
+  if (inode != NULL)
+    grab_inode(inode);
+  lock_release(&open_inodes_lock);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
   inode = malloc(sizeof *inode);
@@ -192,13 +384,23 @@ inode_open(block_sector_t sector)
   struct inode_disk inode_disk; // 定义一个inode_dick来获取指定扇区的内容
 
   /* Initialize. */
-  list_push_front(&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init(&inode->lock);                           // 初始化该文件的文件锁
-  block_read(fs_device, inode->sector, &inode_disk); // 将指定扇区的内容读取到inode_disk中
+  inode->dirty = false;
+  inode->closing = false;
+  inode->run = NULL;
+  inode->ahead_next = 0;
+  inode->ahead_window = 0;
+  inode->ahead_end = 0;
+  rwlock_init(&inode->lock);                 // 初始化该文件的文件锁
+  rwlock_init(&inode->data_lock);
+  lock_init(&inode->memo_lock);
+  lock_init(&inode->range_lock);
+  list_init(&inode->write_ranges);
+  cond_init(&inode->range_released);
+  cache_read(inode->sector, &inode_disk);    // 将指定扇区的内容读取到inode_disk中
   // 将inode_disk的属性赋值给inode对应的属性
   inode->length = inode_disk.length;
   inode->read_length = inode_disk.length;
@@ -209,6 +411,25 @@ inode_open(block_sector_t sector)
   inode->parent = inode_disk.parent;
   // 将inode_disk的索引数组拷贝给inode的索引数组
   memcpy(&inode->blocks, &inode_disk.blocks, INODE_PTRS * sizeof(block_sector_t));
+  inode->format = inode_disk.format;
+  inode->extent_depth = inode_disk.extent_depth;
+  inode->extent_cnt = inode_disk.extent_cnt;
+  memcpy(&inode->extents, &inode_disk.extents, sizeof inode->extents);
+  inode->extent_hit.cnt = 0;
+
+  // 读取inode_disk时没有持有open_inodes_lock，其间可能有其他线程打开了同一个inode
+  lock_acquire(&open_inodes_lock);
+  other = find_inode(sector);
+  if (other != NULL)
+    grab_inode(other);
+  else
+    hash_insert(&open_inodes, &inode->elem);
+  lock_release(&open_inodes_lock);
+  if (other != NULL)
+  {
+    free(inode);
+    return other;
+  }
   return inode; // 完成了属性转移后返回该inode
 }
 
@@ -217,7 +438,11 @@ struct inode *
 inode_reopen(struct inode *inode)
 {
   if (inode != NULL)
+  {
+    lock_acquire(&open_inodes_lock);
     inode->open_cnt++;
+    lock_release(&open_inodes_lock);
+  }
   return inode;
 }
 
@@ -228,6 +453,25 @@ inode_get_inumber(const struct inode *inode)
   return inode->sector;
 }
 
+// 将inode的属性赋值给inode_disk
+static void
+inode_to_disk(const struct inode *inode, struct inode_disk *inode_disk)
+{
+  inode_disk->length = inode->length;
+  inode_disk->magic = INODE_MAGIC;
+  inode_disk->direct_index = inode->direct_index;
+  inode_disk->indirect_index = inode->indirect_index;
+  inode_disk->double_indirect_index = inode->double_indirect_index;
+  inode_disk->is_dir = inode->is_dir;
+  inode_disk->parent = inode->parent;
+  memcpy(&inode_disk->blocks, &inode->blocks, INODE_PTRS * sizeof(block_sector_t));
+  inode_disk->format = inode->format;
+  inode_disk->extent_depth = inode->extent_depth;
+  inode_disk->extent_cnt = inode->extent_cnt;
+  memcpy(&inode_disk->extents, &inode->extents, sizeof inode_disk->extents);
+  memset(&inode_disk->unused, 0, sizeof inode_disk->unused);
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
@@ -239,32 +483,51 @@ void inode_close(struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  // 正在写回的关闭者在写回后会重新检查打开者数量、删除标记和修改标记
+  lock_acquire(&open_inodes_lock);
+  if (--inode->open_cnt > 0 || inode->closing)
   {
-    /* Remove from inode list and release lock. */
-    list_remove(&inode->elem);
+    lock_release(&open_inodes_lock);
+    return;
+  }
 
-    /* Deallocate blocks if removed. */
-    if (inode->removed)
-    {
-      free_map_release(inode->sector, 1);
-      inode_free(inode);
-    }
-    else // inode的内容可能发生了更改，首先将其写入到inode_disk中此后写回到磁盘指定扇区
-    {
-      inode_disk.length = inode->length;
-      inode_disk.magic = INODE_MAGIC;
-      inode_disk.direct_index = inode->direct_index;
-      inode_disk.indirect_index = inode->indirect_index;
-      inode_disk.double_indirect_index = inode->double_indirect_index;
-      inode_disk.is_dir = inode->is_dir;
-      inode_disk.parent = inode->parent;
-      memcpy(&inode_disk.blocks, &inode->blocks, INODE_PTRS * sizeof(block_sector_t));
-      block_write(fs_device, inode->sector, &inode_disk);
-    }
+  // 写回inode扇区或者释放被删除的inode都是一次日志操作，在释放open_inodes_lock之后进行
+  // 写回期间inode处于closing状态，可以被再次打开，但不会被放入closed_inodes或者释放
+  while (inode->open_cnt == 0 && !inode->removed && inode->dirty)
+  {
+    inode_to_disk(inode, &inode_disk);
+    inode->dirty = false;
+    inode->closing = true;
+    lock_release(&open_inodes_lock);
+    journal_start();
+    cache_write_meta(inode->sector, &inode_disk);
+    journal_stop();
+    lock_acquire(&open_inodes_lock);
+    inode->closing = false;
+  }
 
+  if (inode->open_cnt > 0)
+    lock_release(&open_inodes_lock);
+  /* Deallocate blocks if removed. */
+  else if (inode->removed)
+  {
+    hash_delete(&open_inodes, &inode->elem);
+    lock_release(&open_inodes_lock);
+    journal_start();
+    free_map_release(inode->sector, 1);
+    inode_free(inode);
+    journal_stop();
+    free(inode->run);
     free(inode);
   }
+  else
+  {
+    // 没有修改的inode不写回，保留在closed_inodes中，超过数量上限时释放最早关闭的inode
+    list_push_front(&closed_inodes, &inode->closed_elem);
+    if (++closed_cnt > INODE_CLOSED_MAX)
+      drop_closed(list_entry(list_back(&closed_inodes), struct inode, closed_elem));
+    lock_release(&open_inodes_lock);
+  }
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -275,6 +538,83 @@ void inode_remove(struct inode *inode)
   inode->removed = true;
 }
 
+// 根据本次读取的范围[offset, end)调整inode的预读窗口，并按照文件的逻辑块顺序提交预读
+static void
+read_ahead(struct inode *inode, off_t length, off_t offset, off_t end)
+{
+  size_t first = offset / BLOCK_SECTOR_SIZE;
+  size_t last = (end - 1) / BLOCK_SECTOR_SIZE;
+  size_t block, limit;
+
+  // 从上次读取结束的块（或其后一块）开始读取视为顺序读，此时将窗口加倍，否则窗口清零
+  if (first == inode->ahead_next || first + 1 == inode->ahead_next)
+  {
+    inode->ahead_window = inode->ahead_window == 0 ? 1 : inode->ahead_window * 2;
+    if (inode->ahead_window > READ_AHEAD_MAX)
+      inode->ahead_window = READ_AHEAD_MAX;
+  }
+  else
+  {
+    inode->ahead_window = 0;
+    inode->ahead_end = 0;
+  }
+  inode->ahead_next = last + 1;
+
+  // 已经提交过预读的块不再重复提交，从未写入过的块读出全0因此不需要预读
+  block = last + 1 > inode->ahead_end ? last + 1 : inode->ahead_end;
+  limit = last + 1 + inode->ahead_window;
+  for (; block < limit && (off_t)(block * BLOCK_SECTOR_SIZE) < length &&
+         !block_unwritten(inode, block);
+       block++)
+    ahead_reader(byte_to_sector(inode, length, block * BLOCK_SECTOR_SIZE));
+  if (block > inode->ahead_end)
+    inode->ahead_end = block;
+}
+
+// 原地写入所锁定的字节范围[start, end)
+struct write_range
+{
+  off_t start;           // 起始位置
+  off_t end;             // 结束位置（不含）
+  struct list_elem elem; // inode->write_ranges中的元素
+};
+
+// 等待与[start, end)重叠的范围全部解锁后锁定该范围，互不重叠的写入可以同时进行
+static void
+range_acquire(struct inode *inode, struct write_range *range, off_t start, off_t end)
+{
+  struct list_elem *e;
+
+  range->start = start;
+  range->end = end;
+  lock_acquire(&inode->range_lock);
+  for (;;)
+  {
+    // 范围按起始位置排序，遇到起始位置不小于end的范围即可停止
+    for (e = list_begin(&inode->write_ranges); e != list_end(&inode->write_ranges); e = list_next(e))
+    {
+      struct write_range *r = list_entry(e, struct write_range, elem);
+      if (r->start >= end || r->end > start)
+        break;
+    }
+    if (e == list_end(&inode->write_ranges) || list_entry(e, struct write_range, elem)->start >= end)
+      break;
+    cond_wait(&inode->range_released, &inode->range_lock);
+  }
+  list_insert(e, &range->elem);
+  lock_release(&inode->range_lock);
+}
+
+// 解锁字节范围并唤醒等待的写入者
+static void
+range_release(struct inode *inode, struct write_range *range)
+{
+  lock_acquire(&inode->range_lock);
+  list_remove(&range->elem);
+  cond_broadcast(&inode->range_released, &inode->range_lock);
+  lock_release(&inode->range_lock);
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
@@ -283,15 +623,31 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  off_t length = inode->read_length; // 获取到inode的可读取总长度
+  off_t length;
 
+  rwlock_acquire_read(&inode->data_lock);
+  length = inode->read_length; // 获取到inode的可读取总长度
   if (offset >= length)
+  {
+    rwlock_release_read(&inode->data_lock);
     return 0;
+  }
+
+  // 内联格式的文件直接从inode中复制，不访问Cache
+  if (inode->format == INODE_INLINE)
+  {
+    bytes_read = size < length - offset ? size : length - offset;
+    memcpy(buffer, inline_data(inode) + offset, bytes_read);
+    lock_acquire(&inode->memo_lock);
+    inode->read_length = inode_length(inode);
+    lock_release(&inode->memo_lock);
+    rwlock_release_read(&inode->data_lock);
+    return bytes_read;
+  }
 
   while (size > 0)
   {
-    /* Disk sector to read, starting byte offset within sector. */
-    block_sector_t sector_idx = byte_to_sector(inode, length, offset);
+    /* Starting byte offset within sector. */
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
     /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -303,50 +659,204 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset
     int chunk_size = size < min_left ? size : min_left;
     if (chunk_size <= 0)
       break;
-    // 将本来需要通过系统调用实现的读取转换为从缓冲区中进行读取
-    int cache_idx = access_cache_entry(sector_idx, false);
-    memcpy(buffer + bytes_read, cache_array[cache_idx].block + sector_ofs,
-           chunk_size);
-    cache_array[cache_idx].accessed = true;
-    cache_array[cache_idx].open_cnt--;
+    // 查找缓存可能被同时读取该文件的其他线程修改
+    lock_acquire(&inode->memo_lock);
+    bool unwritten = block_unwritten(inode, offset / BLOCK_SECTOR_SIZE);
+    block_sector_t sector_idx = unwritten ? 0 : byte_to_sector(inode, length, offset);
+    lock_release(&inode->memo_lock);
+    // 从未写入过的块直接读出全0，不访问磁盘
+    if (unwritten)
+      memset(buffer + bytes_read, 0, chunk_size);
+    else
+    {
+      // 将本来需要通过系统调用实现的读取转换为从缓冲区中进行读取
+      int cache_idx = access_cache_entry(sector_idx);
+      memcpy(buffer + bytes_read, cache_array[cache_idx].block + sector_ofs,
+             chunk_size);
+      release_cache_entry(cache_idx, false);
+    }
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_read += chunk_size;
   }
+  lock_acquire(&inode->memo_lock);
+  if (bytes_read > 0)
+    read_ahead(inode, length, offset - bytes_read, offset);
   inode->read_length = inode_length(inode);
+  lock_release(&inode->memo_lock);
+  rwlock_release_read(&inode->data_lock);
   return bytes_read;
 }
 
+// 目录和空闲扇区位图的内容是元数据，由日志负责写回
+static bool
+is_meta(const struct inode *inode)
+{
+  return inode->is_dir || inode->sector == FREE_MAP_SECTOR;
+}
+
+// 固定inode_write_at要写入的Cache块，create为true时不读入而是清零，元数据块在修改之前加入日志的当前事务
+static int
+acquire_block(const struct inode *inode, block_sector_t sector, bool create)
+{
+  if (is_meta(inode))
+    return create ? create_meta_entry(sector) : access_meta_entry(sector);
+  return create ? create_cache_entry(sector) : access_cache_entry(sector);
+}
+
+// 释放inode_write_at写入的Cache块
+static void
+release_block(const struct inode *inode, int cache_idx)
+{
+  if (is_meta(inode))
+    release_meta_entry(cache_idx);
+  else
+    release_cache_entry(cache_idx, true);
+}
+
+// 将内联格式的inode转为区段格式，原有内容写入第一个数据块，扇区不足时保持内联格式并返回false
+// 新的inode扇区在关闭时写回，此前断电时磁盘上仍是完整的内联内容
+static bool
+inline_to_extents(struct inode *inode)
+{
+  uint8_t data[INODE_INLINE_MAX];
+  off_t length = inode->length;
+  int cache_idx;
+
+  memcpy(data, inline_data(inode), length);
+  memset(inode->extents, 0, sizeof inode->extents);
+  inode->format = INODE_EXTENTS;
+  inode->dirty = true;
+  inode->extent_depth = 0;
+  inode->extent_cnt = 0;
+  inode->extent_hit.cnt = 0;
+  inode->length = 0;
+  if (length == 0)
+    return true;
+
+  inode->length = extent_grow(inode, length);
+  if (inode->length < length)
+  {
+    extent_free(inode);
+    memcpy(inline_data(inode), data, length);
+    memset(inline_data(inode) + length, 0, INODE_INLINE_MAX - length);
+    inode->format = INODE_INLINE;
+    inode->extent_cnt = 0;
+    inode->length = length;
+    return false;
+  }
+  cache_idx = acquire_block(inode, extent_lookup(inode, 0), true);
+  memcpy(cache_array[cache_idx].block, data, length);
+  release_block(inode, cache_idx);
+  extent_written(inode, 0);
+  return true;
+}
+
+// 判断[start, end)中是否有从未写入过的块，写入这样的块需要修改区段，调用者共享持有data_lock
+// 调用者保证end不超过文件长度
+static bool
+range_unwritten(struct inode *inode, off_t start, off_t end)
+{
+  size_t block = start / BLOCK_SECTOR_SIZE;
+  size_t last = (end - 1) / BLOCK_SECTOR_SIZE;
+  bool unwritten = false;
+
+  if (inode->format != INODE_EXTENTS || start >= end)
+    return false;
+  lock_acquire(&inode->memo_lock);
+  while (!unwritten && block <= last)
+  {
+    struct extent e = extent_find(inode, block);
+    if (block - e.block < e.init)
+      block = e.block + e.init;
+    else
+      unwritten = true;
+  }
+  lock_release(&inode->memo_lock);
+  return unwritten;
+}
+
+// 第一次写入区段中的逻辑块block之前，将同一区段中位于它之前的未写入的块在Cache中清零
+// 使已写入的块始终是区段的开头部分，其他区段中的空洞不受影响，独占data_lock时调用
+static void
+extent_fill(struct inode *inode, size_t block)
+{
+  struct extent e = extent_find(inode, block);
+  size_t b;
+
+  for (b = e.block + e.init; b < block; b++)
+    release_block(inode, acquire_block(inode, e.start + (b - e.block), true));
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
    (Normally a write at end of file would extend the inode, but
    growth is not yet implemented.) */
 // 从inode的offset位置开始将buffer缓冲区中的size个byte写入扇区，需要考虑offset+size大于inode的总长度
-// 在扩容的时候需要加锁
+// 扩展文件或者写入从未写入过的块时需要修改长度、块映射或区段的已写入部分，独占data_lock
+// 否则只共享持有data_lock并锁定写入的字节范围，对同一文件不重叠范围的写入以及读取可以同时进行
+// 整个写入是一次日志操作，扩展文件时修改的区段树节点与目录项等其他元数据属于同一个事务
+// 内联格式的写入修改inode扇区本身，总是独占data_lock
 off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t offset)
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
+  struct write_range range;
+  bool exclusive;
+
+  journal_start();
+  rwlock_acquire_read(&inode->data_lock);
+  exclusive = offset + size > inode_length(inode) || inode->format == INODE_INLINE ||
+              range_unwritten(inode, offset, offset + size);
+  if (exclusive)
+  {
+    rwlock_release_read(&inode->data_lock);
+    rwlock_acquire_write(&inode->data_lock);
+  }
+  else
+    range_acquire(inode, &range, offset, offset + size);
 
   if (inode->deny_write_cnt)
-    return 0;
-  inode_deny_write(inode);
+    goto done;
+  // 内联格式放不下时先将内容移到数据块中
+  if (inode->format == INODE_INLINE && offset + size > INODE_INLINE_MAX && !inline_to_extents(inode))
+    goto done;
   // 如果offset+size大于inode的总长度那么就将inode进行扩容
+  // 写入位置之前的空洞先单独扩展，使空洞中的块与写入的块不在同一个区段中，空洞不需要清零
+  if (inode->format == INODE_EXTENTS && ROUND_DOWN(offset, BLOCK_SECTOR_SIZE) > inode_length(inode))
+  {
+    inode->length = inode_grow(inode, ROUND_DOWN(offset, BLOCK_SECTOR_SIZE));
+    inode->dirty = true;
+  }
   if (offset + size > inode_length(inode))
   {
-    if (!inode->is_dir)
-      lock_acquire(&inode->lock);
     inode->length = inode_grow(inode, offset + size);
-    if (!inode->is_dir)
-      lock_release(&inode->lock);
+    inode->dirty = true;
+  }
+
+  // 内联格式直接修改inode中的内容，并将inode扇区作为元数据写入Cache
+  if (inode->format == INODE_INLINE)
+  {
+    memcpy(inline_data(inode) + offset, buffer, size);
+    bytes_written = size;
+    // 直接在Cache块中生成整个inode扇区，不在栈上放置inode_disk
+    int cache_idx = create_meta_entry(inode->sector);
+    inode_to_disk(inode, (struct inode_disk *)cache_array[cache_idx].block);
+    release_meta_entry(cache_idx);
+    goto done;
   }
 
   while (size > 0)
   {
     /* Sector to write, starting byte offset within sector. */
+    // 查找缓存可能被同时读取该文件的其他线程使用，共享持有data_lock时range_unwritten已经排除了未写入的块
+    lock_acquire(&inode->memo_lock);
     block_sector_t sector_idx = byte_to_sector(inode, inode_length(inode), offset);
+    bool unwritten = exclusive && offset < inode_length(inode) &&
+                     block_unwritten(inode, offset / BLOCK_SECTOR_SIZE);
+    lock_release(&inode->memo_lock);
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
     /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -359,18 +869,38 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t
     if (chunk_size <= 0)
       break;
 
+    // 从未写入过的块在Cache中清零后直接写入，写入后延长区段的已写入部分
+    if (unwritten)
+      extent_fill(inode, offset / BLOCK_SECTOR_SIZE);
+
     // 将本来需要通过系统调用实现的写入转换为写入缓冲区
-    int cache_idx = access_cache_entry(sector_idx, true);
+    int cache_idx = acquire_block(inode, sector_idx, unwritten);
     memcpy(cache_array[cache_idx].block + sector_ofs, buffer + bytes_written, chunk_size);
-    cache_array[cache_idx].accessed = true;
-    cache_array[cache_idx].dirty = true;
-    cache_array[cache_idx].open_cnt--;
+    release_block(inode, cache_idx);
+    if (unwritten)
+      extent_written(inode, offset / BLOCK_SECTOR_SIZE);
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_written += chunk_size;
   }
-  inode_allow_write(inode);
+
+done:
+  // 写入完成后扩展的部分才对读者可见，否则同一个打开的文件紧接着的读取会读不到刚写入的内容
+  if (bytes_written > 0)
+  {
+    lock_acquire(&inode->memo_lock);
+    inode->read_length = inode_length(inode);
+    lock_release(&inode->memo_lock);
+  }
+  if (exclusive)
+    rwlock_release_write(&inode->data_lock);
+  else
+  {
+    range_release(inode, &range);
+    rwlock_release_read(&inode->data_lock);
+  }
+  journal_stop();
   return bytes_written;
 }
 
@@ -378,8 +908,10 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t
    May be called at most once per inode opener. */
 void inode_deny_write(struct inode *inode)
 {
+  rwlock_acquire_write(&inode->data_lock);
   inode->deny_write_cnt++;
   ASSERT(inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write(&inode->data_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -387,9 +919,11 @@ void inode_deny_write(struct inode *inode)
    inode_deny_write() on the inode, before closing the inode. */
 void inode_allow_write(struct inode *inode)
 {
+  rwlock_acquire_write(&inode->data_lock);
   ASSERT(inode->deny_write_cnt > 0);
   ASSERT(inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write(&inode->data_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -399,39 +933,73 @@ off_t inode_length(const struct inode *inode)
   return inode->length;
 }
 
-// 根据inode_disk来生成一个inode并将inode的数据回调给inode_dick
-bool inode_alloc(struct inode_disk *inode_disk)
+// 根据inode_disk来生成一个inode并将inode的数据回调给inode_dick，sector为inode所在扇区
+// 区段格式的inode分配不到足够的扇区时释放已分配的扇区并返回false
+bool inode_alloc(block_sector_t sector, struct inode_disk *inode_disk)
 {
   struct inode inode;
+  inode.sector = sector;
   inode.length = 0;
   inode.direct_index = 0;
   inode.indirect_index = 0;
   inode.double_indirect_index = 0;
-
-  inode_grow(&inode, inode_disk->length);
+  inode.run = NULL;
+  inode.format = inode_disk->format;
+  inode.extent_depth = 0;
+  inode.extent_cnt = 0;
+  inode.extent_hit.cnt = 0;
+
+  inode.length = inode_grow(&inode, inode_disk->length);
+  if (inode.length < inode_disk->length)
+  {
+    inode_free(&inode);
+    return false;
+  }
   inode_disk->direct_index = inode.direct_index;
   inode_disk->indirect_index = inode.indirect_index;
   inode_disk->double_indirect_index = inode.double_indirect_index;
   memcpy(&inode_disk->blocks, &inode.blocks, INODE_PTRS * sizeof(block_sector_t));
+  inode_disk->extent_depth = inode.extent_depth;
+  inode_disk->extent_cnt = inode.extent_cnt;
+  if (inode.format != INODE_INLINE) // 内联格式的内容由调用者清零
+    memcpy(&inode_disk->extents, &inode.extents, sizeof inode_disk->extents);
   return true;
 }
 // 将inode的长度扩展到指定的length长度
 off_t inode_grow(struct inode *inode, off_t length)
 {
-  static char zeros[BLOCK_SECTOR_SIZE];
-
   size_t grow_sectors = bytes_to_sectors(length) - bytes_to_sectors(inode->length);
 
+  // 内联格式在inode_write_at中转为区段格式之后才会超过INODE_INLINE_MAX
+  if (inode->format == INODE_INLINE)
+  {
+    ASSERT(length <= INODE_INLINE_MAX);
+    return length;
+  }
   if (grow_sectors == 0)
   {
     return length;
   }
+  if (inode->format == INODE_EXTENTS)
+    return extent_grow(inode, length);
+  indexed_grow(inode, grow_sectors);
+  return length;
+}
+
+// 为索引格式的inode追加grow_sectors个清零的扇区
+// 索引块的数组占用较多的栈空间，不内联到inode_grow中，以免区段格式的扩展也占用这些栈空间
+static void NO_INLINE
+indexed_grow(struct inode *inode, size_t grow_sectors)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  invalidate_run(inode);
 
   // 直接索引
   while (inode->direct_index < DIRECT_BLOCKS && grow_sectors != 0)
   {
     free_map_allocate(1, &inode->blocks[inode->direct_index]);
-    block_write(fs_device, inode->blocks[inode->direct_index], zeros);
+    cache_write(inode->blocks[inode->direct_index], zeros);
     inode->direct_index++;
     grow_sectors--;
   }
@@ -445,19 +1013,19 @@ off_t inode_grow(struct inode *inode, off_t length)
     if (inode->indirect_index == 0)
       free_map_allocate(1, &inode->blocks[inode->direct_index]);
     else
-      block_read(fs_device, inode->blocks[inode->direct_index], &blocks);
+      cache_read(inode->blocks[inode->direct_index], &blocks);
 
     // 为一级索引对应的扇区中的每一个分区分配扇区编号
     while (inode->indirect_index < INDIRECT_PTRS && grow_sectors != 0)
     {
       free_map_allocate(1, &blocks[inode->indirect_index]);
-      block_write(fs_device, blocks[inode->indirect_index], zeros);
+      cache_write(blocks[inode->indirect_index], zeros);
       inode->indirect_index++;
       grow_sectors--;
     }
 
     // 将blocks数组写入扇区
-    block_write(fs_device, inode->blocks[inode->direct_index], &blocks);
+    cache_write_meta(inode->blocks[inode->direct_index], &blocks);
 
     // 下一轮一级索引的循环
     if (inode->indirect_index == INDIRECT_PTRS)
@@ -477,7 +1045,7 @@ off_t inode_grow(struct inode *inode, off_t length)
     if (inode->double_indirect_index == 0 && inode->indirect_index == 0)
       free_map_allocate(1, &inode->blocks[inode->direct_index]);
     else
-      block_read(fs_device, inode->blocks[inode->direct_index], &level_one);
+      cache_read(inode->blocks[inode->direct_index], &level_one);
 
     // 为二级索引对应的扇区中的每一个分区分配扇区编号
     while (inode->indirect_index < INDIRECT_PTRS && grow_sectors != 0)
@@ -485,18 +1053,18 @@ off_t inode_grow(struct inode *inode, off_t length)
       if (inode->double_indirect_index == 0)
         free_map_allocate(1, &level_one[inode->indirect_index]);
       else
-        block_read(fs_device, level_one[inode->indirect_index], &level_two);
+        cache_read(level_one[inode->indirect_index], &level_two);
 
       while (inode->double_indirect_index < INDIRECT_PTRS && grow_sectors != 0)
       {
         free_map_allocate(1, &level_two[inode->double_indirect_index]);
-        block_write(fs_device, level_two[inode->double_indirect_index], zeros);
+        cache_write(level_two[inode->double_indirect_index], zeros);
         inode->double_indirect_index++;
         grow_sectors--;
       }
 
       // 将level_two数组写入扇区
-      block_write(fs_device, level_one[inode->indirect_index], &level_two);
+      cache_write_meta(level_one[inode->indirect_index], &level_two);
 
       // 下一轮二级索引的循环
       if (inode->double_indirect_index == INDIRECT_PTRS)
@@ -507,10 +1075,8 @@ off_t inode_grow(struct inode *inode, off_t length)
     }
 
     // 将level_one数组写入扇区
-    block_write(fs_device, inode->blocks[inode->direct_index], &level_one);
+    cache_write_meta(inode->blocks[inode->direct_index], &level_one);
   }
-
-  return length;
 }
 
 // 将指定的inode中所占据的所有扇区内容释放
@@ -519,10 +1085,15 @@ void inode_free(struct inode *inode)
   size_t sector_num = bytes_to_sectors(inode->length);
   size_t idx = 0;
 
-  if (sector_num == 0)
+  if (sector_num == 0 || inode->format == INODE_INLINE)
   {
     return;
   }
+  if (inode->format == INODE_EXTENTS)
+  {
+    extent_free(inode);
+    return;
+  }
 
   // 释放直接索引
   while (idx < DIRECT_BLOCKS && sector_num != 0)
@@ -540,7 +1111,7 @@ void inode_free(struct inode *inode)
 
     size_t i;
     block_sector_t block[128];
-    block_read(fs_device, inode->blocks[idx], &block);
+    cache_read(inode->blocks[idx], &block);
 
     for (i = 0; i < free_blocks; i++)
     {
@@ -559,7 +1130,7 @@ void inode_free(struct inode *inode)
     block_sector_t level_one[128], level_two[128];
 
     // 读取level_one索引数组
-    block_read(fs_device, inode->blocks[INODE_PTRS - 1], &level_one);
+    cache_read(inode->blocks[INODE_PTRS - 1], &level_one);
 
     size_t indirect_blocks = DIV_ROUND_UP(sector_num, INDIRECT_PTRS * BLOCK_SECTOR_SIZE);
 
@@ -568,7 +1139,7 @@ void inode_free(struct inode *inode)
       size_t free_blocks = sector_num < INDIRECT_PTRS ? sector_num : INDIRECT_PTRS;
 
       // 读取level_two索引数组
-      block_read(fs_device, level_one[i], &level_two);
+      cache_read(level_one[i], &level_two);
 
       for (j = 0; j < free_blocks; j++)
       {
@@ -583,6 +1154,308 @@ void inode_free(struct inode *inode)
   }
 }
 
+// 在按逻辑块号升序排列的cnt个区段中二分查找包含逻辑块block的区段的下标
+static size_t
+extent_search(const struct extent *extents, size_t cnt, size_t block)
+{
+  size_t lo = 0, hi = cnt;
+  while (hi - lo > 1)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (extents[mid].block <= block)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// 从区段树的根开始逐层二分查找包含逻辑块block的叶子区段，并记住命中的叶子区段
+static struct extent
+extent_find(struct inode *inode, size_t block)
+{
+  struct extent e;
+  uint32_t depth;
+
+  if (inode->extent_hit.cnt != 0 && block >= inode->extent_hit.block &&
+      block < inode->extent_hit.block + inode->extent_hit.cnt)
+    return inode->extent_hit;
+
+  e = inode->extents[extent_search(inode->extents, inode->extent_cnt, block)];
+  for (depth = inode->extent_depth; depth > 0; depth--)
+  {
+    int cache_idx = access_cache_entry(e.start);
+    struct extent_node *node = (struct extent_node *)cache_array[cache_idx].block;
+    e = node->entries[extent_search(node->entries, node->cnt, block)];
+    release_cache_entry(cache_idx, false);
+  }
+
+  inode->extent_hit = e;
+  return e;
+}
+
+// 查找逻辑块block所在的扇区
+static block_sector_t
+extent_lookup(struct inode *inode, size_t block)
+{
+  struct extent e = extent_find(inode, block);
+  return e.start + (block - e.block);
+}
+
+// 逻辑块block写入数据后将其所在叶子区段的已写入部分延长到包含block，独占data_lock时调用
+// 叶子区段在区段树节点中时，节点在修改之前加入日志的当前事务
+static void
+extent_written(struct inode *inode, size_t block)
+{
+  struct extent *entries = inode->extents;
+  size_t cnt = inode->extent_cnt, i;
+  uint32_t depth;
+  int cache_idx = -1;
+  bool dirty = false;
+
+  i = extent_search(entries, cnt, block);
+  for (depth = inode->extent_depth; depth > 0; depth--)
+  {
+    block_sector_t child = entries[i].start;
+    if (cache_idx != -1)
+      release_cache_entry(cache_idx, false);
+    cache_idx = access_cache_entry(child);
+    struct extent_node *node = (struct extent_node *)cache_array[cache_idx].block;
+    entries = node->entries;
+    cnt = node->cnt;
+    i = extent_search(entries, cnt, block);
+  }
+
+  if (block - entries[i].block >= entries[i].init)
+  {
+    if (cache_idx != -1)
+      join_meta_entry(cache_idx);
+    entries[i].init = block - entries[i].block + 1;
+    dirty = true;
+  }
+  inode->extent_hit = entries[i];
+
+  // 叶子区段在inode中时随inode扇区写回
+  if (cache_idx == -1)
+  {
+    inode->dirty |= dirty;
+    return;
+  }
+  if (dirty)
+    release_meta_entry(cache_idx);
+  else
+    release_cache_entry(cache_idx, false);
+}
+
+// 判断区段e是否紧接在叶子区段last之后，此时可以直接合并到last中
+// 已写入的块必须是区段的开头部分，因此last中还有未写入的块时不合并
+static bool
+extent_contiguous(const struct extent *last, const struct extent *e)
+{
+  return last->start + last->cnt == e->start && last->block + last->cnt == e->block &&
+         last->init == last->cnt && last->cnt + e->cnt <= EXTENT_MAX_CNT;
+}
+
+// 将区段e合并到紧接在其前面的叶子区段last中
+static void
+extent_merge(struct extent *last, const struct extent *e)
+{
+  last->cnt += e->cnt;
+  last->init += e->init;
+}
+
+// 为区段e新建一条高度为height的节点链，叶子只包含e，将最上层节点的扇区编号存入sectorp
+// 节点尽量分配在goal附近，直接在Cache块中构造，不在栈上放置整个扇区
+static bool
+extent_path(uint32_t height, const struct extent *e, block_sector_t goal, block_sector_t *sectorp)
+{
+  block_sector_t sectors[EXTENT_MAX_DEPTH];
+  struct extent entry = *e;
+  uint32_t h;
+
+  ASSERT(height < EXTENT_MAX_DEPTH);
+  for (h = 0; h <= height; h++)
+  {
+    if (!free_map_allocate_near(1, goal, &sectors[h]))
+    {
+      while (h-- > 0)
+        free_map_release(sectors[h], 1);
+      return false;
+    }
+    int cache_idx = create_meta_entry(sectors[h]);
+    struct extent_node *node = (struct extent_node *)cache_array[cache_idx].block;
+    node->cnt = 1;
+    node->entries[0] = entry;
+    release_meta_entry(cache_idx);
+    entry.start = sectors[h];
+    entry.cnt = 0;
+    entry.init = 0;
+  }
+  *sectorp = sectors[height];
+  return true;
+}
+
+// 将区段e追加到扇区sector中高度为height的子树的最右侧，子树已满时返回false
+// 新节点尽量分配在goal附近
+static bool
+node_append(block_sector_t sector, uint32_t height, const struct extent *e, block_sector_t goal)
+{
+  int cache_idx = access_cache_entry(sector);
+  struct extent_node *node = (struct extent_node *)cache_array[cache_idx].block;
+  bool appended = true, dirty = true;
+  block_sector_t child;
+
+  // 节点在修改之前加入日志的当前事务
+  if (height == 0 && node->cnt > 0 && extent_contiguous(&node->entries[node->cnt - 1], e))
+  {
+    join_meta_entry(cache_idx);
+    extent_merge(&node->entries[node->cnt - 1], e);
+  }
+  else if (height > 0 && node_append(node->entries[node->cnt - 1].start, height - 1, e, goal))
+    dirty = false;
+  else if (node->cnt < EXTENT_NODE_CNT && (height == 0 || extent_path(height - 1, e, goal, &child)))
+  {
+    join_meta_entry(cache_idx);
+    node->entries[node->cnt] = *e;
+    if (height > 0)
+    {
+      node->entries[node->cnt].start = child;
+      node->entries[node->cnt].cnt = 0;
+      node->entries[node->cnt].init = 0;
+    }
+    node->cnt++;
+  }
+  else
+    appended = dirty = false;
+
+  if (dirty)
+    release_meta_entry(cache_idx);
+  else
+    release_cache_entry(cache_idx, false);
+  return appended;
+}
+
+// 将区段e追加到inode的区段树中，根已满时把根移入新的节点使树增高一层
+// 区段树的节点尽量分配在inode所在扇区附近，不占用数据块后面的连续空间
+static bool
+extent_append(struct inode *inode, const struct extent *e)
+{
+  struct extent_node *node;
+  block_sector_t child;
+  int cache_idx;
+
+  if (inode->extent_depth == 0)
+  {
+    if (inode->extent_cnt > 0 &&
+        extent_contiguous(&inode->extents[inode->extent_cnt - 1], e))
+    {
+      extent_merge(&inode->extents[inode->extent_cnt - 1], e);
+      return true;
+    }
+    if (inode->extent_cnt < INODE_EXTENTS_CNT)
+    {
+      inode->extents[inode->extent_cnt++] = *e;
+      return true;
+    }
+  }
+  else
+  {
+    if (node_append(inode->extents[inode->extent_cnt - 1].start, inode->extent_depth - 1, e, inode->sector))
+      return true;
+    if (inode->extent_cnt < INODE_EXTENTS_CNT)
+    {
+      if (!extent_path(inode->extent_depth - 1, e, inode->sector, &child))
+        return false;
+      inode->extents[inode->extent_cnt].block = e->block;
+      inode->extents[inode->extent_cnt].start = child;
+      inode->extents[inode->extent_cnt].cnt = 0;
+      inode->extents[inode->extent_cnt].init = 0;
+      inode->extent_cnt++;
+      return true;
+    }
+  }
+
+  // 根已满，将根中的区段移入一个新节点，根中只保留指向该节点的区段
+  // 新节点直接在Cache块中构造，递归调用时栈上不保留整个扇区
+  if (inode->extent_depth == EXTENT_MAX_DEPTH || !free_map_allocate_near(1, inode->sector, &child))
+    return false;
+  cache_idx = create_meta_entry(child);
+  node = (struct extent_node *)cache_array[cache_idx].block;
+  node->cnt = inode->extent_cnt;
+  memcpy(node->entries, inode->extents, inode->extent_cnt * sizeof(struct extent));
+  release_meta_entry(cache_idx);
+  inode->extents[0].block = 0;
+  inode->extents[0].start = child;
+  inode->extents[0].cnt = 0;
+  inode->extents[0].init = 0;
+  inode->extent_cnt = 1;
+  inode->extent_depth++;
+  return extent_append(inode, e);
+}
+
+// 将区段格式的inode扩展到length长度，尽量一次分配连续的多个扇区
+// 第一个数据块尽量紧跟在inode之后，其余数据块尽量紧跟在文件的上一个数据块之后
+// 新分配的扇区不写入0，新区段中的块都是未写入的块，读出全0，第一次写入时在Cache中清零
+// 扇区不足时返回实际能够容纳的长度
+static off_t
+extent_grow(struct inode *inode, off_t length)
+{
+  size_t have = bytes_to_sectors(inode->length);
+  size_t want = bytes_to_sectors(length);
+
+  while (have < want)
+  {
+    struct extent e;
+    size_t cnt = want - have < EXTENT_MAX_CNT ? want - have : EXTENT_MAX_CNT;
+    block_sector_t goal = have == 0 ? inode->sector + 1 : extent_lookup(inode, have - 1) + 1;
+
+    // 分配不到cnt个连续扇区时减半重试
+    while (!free_map_allocate_near(cnt, goal, &e.start))
+    {
+      if (cnt == 1)
+        return have * BLOCK_SECTOR_SIZE;
+      cnt /= 2;
+    }
+    e.block = have;
+    e.cnt = cnt;
+    e.init = 0;
+    if (!extent_append(inode, &e))
+    {
+      free_map_release(e.start, cnt);
+      return have * BLOCK_SECTOR_SIZE;
+    }
+    have += cnt;
+  }
+  return length;
+}
+
+// 释放cnt个区段，height为0时区段是叶子区段，否则释放其指向的子树和子节点本身
+static void
+extent_free_entries(const struct extent *entries, size_t cnt, uint32_t height)
+{
+  size_t i;
+  for (i = 0; i < cnt; i++)
+  {
+    if (height == 0)
+      free_map_release(entries[i].start, entries[i].cnt);
+    else
+    {
+      int cache_idx = access_cache_entry(entries[i].start);
+      struct extent_node *node = (struct extent_node *)cache_array[cache_idx].block;
+      extent_free_entries(node->entries, node->cnt, height - 1);
+      release_cache_entry(cache_idx, false);
+      free_map_release(entries[i].start, 1);
+    }
+  }
+}
+
+// 释放区段格式的inode的所有数据扇区和区段树节点
+static void
+extent_free(struct inode *inode)
+{
+  extent_free_entries(inode->extents, inode->extent_cnt, inode->extent_depth);
+}
+
 bool inode_is_dir(const struct inode *inode)
 {
   return inode->is_dir;
@@ -607,16 +1480,27 @@ bool inode_set_parent(block_sector_t parent, block_sector_t child)
     return false;
 
   inode->parent = parent;
+  inode->dirty = true;
   inode_close(inode);
   return true;
 }
 
 void inode_lock(const struct inode *inode)
 {
-  lock_acquire(&((struct inode *)inode)->lock);
+  rwlock_acquire_write(&((struct inode *)inode)->lock);
 }
 
 void inode_unlock(const struct inode *inode)
 {
-  lock_release(&((struct inode *)inode)->lock);
+  rwlock_release_write(&((struct inode *)inode)->lock);
+}
+
+void inode_lock_shared(const struct inode *inode)
+{
+  rwlock_acquire_read(&((struct inode *)inode)->lock);
+}
+
+void inode_unlock_shared(const struct inode *inode)
+{
+  rwlock_release_read(&((struct inode *)inode)->lock);
 }
\ No newline at end of file
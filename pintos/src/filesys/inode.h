@@ -32,4 +32,8 @@ bool inode_set_parent(block_sector_t parent, block_sector_t child);
 void inode_lock(const struct inode *inode);
 // 为inode解锁
 void inode_unlock(const struct inode *inode);
+// 为inode加共享锁，多个线程可以同时持有
+void inode_lock_shared(const struct inode *inode);
+// 释放inode的共享锁
+void inode_unlock_shared(const struct inode *inode);
 #endif /* filesys/inode.h */
@@ -0,0 +1,316 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+// 元数据日志（write-ahead journal）
+// inode、目录和空闲扇区位图的修改都在journal_start和journal_stop之间进行，被修改的Cache块加入当前事务
+// 事务提交前这些块不会写回原位置；提交时在没有进行中的操作的时刻复制事务中所有块的内容，
+// 将描述块和块内容作为一次顺序写入写到日志区域，再写入提交块，此后这些块才可以由Cache写回原位置
+// 日志区域只保存最近一个事务，写入新事务之前先将上一个事务的内容写回原位置（检查点）
+// 并发的操作修改的块属于同一个事务，由一次提交一起写入（组提交）
+#define JOURNAL_MAGIC 0x4a524e4c        // 日志头的魔数
+#define JOURNAL_DESC_MAGIC 0x4a445343   // 描述块的魔数
+#define JOURNAL_COMMIT_MAGIC 0x4a434d54 // 提交块的魔数
+
+// 日志头，位于JOURNAL_SECTOR
+struct journal_header
+{
+  uint32_t magic;       // JOURNAL_MAGIC
+  uint32_t sectors;     // 日志区域的扇区数
+  uint32_t unused[126]; // 未使用
+};
+
+// 描述块，位于JOURNAL_SECTOR + 1，其后紧跟cnt个块的内容
+struct journal_desc
+{
+  uint32_t magic;                           // JOURNAL_DESC_MAGIC，为0时日志为空
+  uint32_t tid;                             // 事务编号
+  uint32_t cnt;                             // 事务中块的数量
+  block_sector_t sectors[JOURNAL_TXN_MAX];  // 每个块在磁盘上的原位置
+  uint32_t unused[128 - 3 - JOURNAL_TXN_MAX]; // 未使用
+};
+
+// 提交块，位于块内容之后，校验和正确时事务才被视为已经提交
+struct journal_commit
+{
+  uint32_t magic;       // JOURNAL_COMMIT_MAGIC
+  uint32_t tid;         // 事务编号，与描述块相同
+  uint32_t cnt;         // 事务中块的数量，与描述块相同
+  uint32_t checksum;    // 描述块和块内容的校验和
+  uint32_t unused[124]; // 未使用
+};
+
+#define JOURNAL_BUF_PAGES DIV_ROUND_UP((JOURNAL_TXN_MAX + 1) * BLOCK_SECTOR_SIZE, PGSIZE)
+
+static bool journal_enabled;        // 是否记录日志
+static size_t journal_capacity;     // 当前事务中的块数与所有操作的预留之和的上限
+static size_t handle_credits;       // 每个操作预留的块数
+static struct lock journal_lock;    // 保护handles和committing
+static struct condition handles_done; // 进行中的操作全部结束
+static struct condition handle_stopped; // 某个进行中的操作结束，其预留被归还
+static struct condition commit_done;  // 提交者已经复制完事务的内容
+static int handles;                 // 进行中的操作数量
+static bool committing;             // 是否有线程正在等待操作结束以复制事务的内容
+
+static struct lock journal_io_lock; // 保证事务按照编号顺序写入日志，并保护以下成员
+static uint8_t *txn_buf;            // 正在提交的事务：描述块和块内容
+static uint8_t *ckpt_buf;           // 上一个已经提交但尚未写回原位置的事务
+static size_t ckpt_cnt;             // ckpt_buf中块的数量
+static struct journal_commit commit_block; // 提交块的缓冲区
+
+// 计算描述块和cnt个块内容的校验和
+static uint32_t
+txn_checksum(const uint8_t *buf, size_t cnt)
+{
+  return hash_bytes(buf, (cnt + 1) * BLOCK_SECTOR_SIZE);
+}
+
+// 将日志中的描述块清零，使日志为空
+static void
+clear_journal(void)
+{
+  memset(&commit_block, 0, sizeof commit_block);
+  block_write(fs_device, JOURNAL_SECTOR + 1, &commit_block);
+}
+
+// 保证ckpt_buf中上一个已经提交的事务的内容（或者更新的已提交内容）已经写回原位置，之后日志区域才可以被覆盖
+static void
+checkpoint(void)
+{
+  struct journal_desc *desc = (struct journal_desc *)ckpt_buf;
+  size_t i;
+
+  for (i = 0; i < ckpt_cnt; i++)
+    cache_checkpoint(desc->sectors[i], ckpt_buf + (i + 1) * BLOCK_SECTOR_SIZE);
+  ckpt_cnt = 0;
+}
+
+void journal_create(void)
+{
+  struct journal_header *header;
+  block_sector_t sector;
+
+  if (!free_map_allocate_near(JOURNAL_SECTORS, JOURNAL_SECTOR, &sector) || sector != JOURNAL_SECTOR)
+    PANIC("journal creation failed");
+
+  header = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+  header->magic = JOURNAL_MAGIC;
+  header->sectors = JOURNAL_SECTORS;
+  block_write(fs_device, JOURNAL_SECTOR, header);
+  palloc_free_page(header);
+  clear_journal();
+}
+
+// 如果日志中有一个完整提交的事务那么将其写回原位置，写回是幂等的，重放中途断电时下次启动会再次重放
+static void
+replay(void)
+{
+  struct journal_desc *desc = (struct journal_desc *)txn_buf;
+  size_t i;
+
+  block_read(fs_device, JOURNAL_SECTOR + 1, desc);
+  if (desc->magic != JOURNAL_DESC_MAGIC || desc->cnt > JOURNAL_TXN_MAX)
+    return;
+  block_read_multiple(fs_device, JOURNAL_SECTOR + 2, desc->cnt, txn_buf + BLOCK_SECTOR_SIZE);
+  block_read(fs_device, JOURNAL_SECTOR + 2 + desc->cnt, &commit_block);
+  if (commit_block.magic != JOURNAL_COMMIT_MAGIC || commit_block.tid != desc->tid ||
+      commit_block.cnt != desc->cnt || commit_block.checksum != txn_checksum(txn_buf, desc->cnt))
+    return;
+
+  for (i = 0; i < desc->cnt; i++)
+    block_write(fs_device, desc->sectors[i], txn_buf + (i + 1) * BLOCK_SECTOR_SIZE);
+}
+
+void journal_init(void)
+{
+  struct journal_header *header;
+  size_t limit, map_sectors;
+  bool valid;
+
+  lock_init(&journal_lock);
+  cond_init(&handles_done);
+  cond_init(&handle_stopped);
+  cond_init(&commit_done);
+  lock_init(&journal_io_lock);
+
+  // 在日志头被格式化程序写入之前的磁盘上，这个扇区属于其他文件
+  header = palloc_get_page(PAL_ASSERT);
+  block_read(fs_device, JOURNAL_SECTOR, header);
+  valid = header->magic == JOURNAL_MAGIC && header->sectors == JOURNAL_SECTORS;
+  palloc_free_page(header);
+  if (!valid)
+    return;
+
+  txn_buf = palloc_get_multiple(PAL_ASSERT, JOURNAL_BUF_PAGES);
+  ckpt_buf = palloc_get_multiple(PAL_ASSERT, JOURNAL_BUF_PAGES);
+  replay();
+  clear_journal();
+
+  // 事务中的块在提交前不能被替换，因此最多占用一半的Cache
+  // 提交时才加入事务的空闲扇区位图不属于任何操作，为其所有扇区保留空间
+  limit = cache_size / 2 < JOURNAL_TXN_MAX ? cache_size / 2 : JOURNAL_TXN_MAX;
+  map_sectors = DIV_ROUND_UP(DIV_ROUND_UP(block_size(fs_device), 8), BLOCK_SECTOR_SIZE);
+  if (limit <= map_sectors)
+  {
+    printf("journal: cache too small, metadata journaling disabled\n");
+    return;
+  }
+  journal_capacity = limit - map_sectors;
+  handle_credits = JOURNAL_HANDLE_CREDITS < journal_capacity ? JOURNAL_HANDLE_CREDITS : journal_capacity;
+  cache_journal_enable(true);
+  free_map_defer_release(true);
+  journal_enabled = true;
+}
+
+void journal_close(void)
+{
+  if (!journal_enabled)
+    return;
+  journal_commit();
+
+  lock_acquire(&journal_io_lock);
+  checkpoint();
+  clear_journal();
+  journal_enabled = false;
+  cache_journal_enable(false);
+  free_map_defer_release(false);
+  lock_release(&journal_io_lock);
+}
+
+void journal_start(void)
+{
+  struct thread *t = thread_current();
+
+  if (!journal_enabled || t->journal_depth++ > 0)
+    return;
+
+  // 正在提交时等待提交者复制完事务；剩余的空间不足以预留时等待其他操作结束并归还预留，
+  // 没有进行中的操作时仍然不足说明事务本身已满，由自己提交
+  lock_acquire(&journal_lock);
+  while (committing || !cache_journal_reserve(handle_credits, journal_capacity))
+  {
+    if (committing)
+      cond_wait(&commit_done, &journal_lock);
+    else if (handles > 0)
+      cond_wait(&handle_stopped, &journal_lock);
+    else
+    {
+      lock_release(&journal_lock);
+      journal_commit();
+      lock_acquire(&journal_lock);
+    }
+  }
+  t->journal_credits = handle_credits;
+  handles++;
+  lock_release(&journal_lock);
+}
+
+void journal_stop(void)
+{
+  struct thread *t = thread_current();
+
+  if (t->journal_depth == 0)
+    return;
+  if (--t->journal_depth > 0)
+    return;
+
+  cache_journal_unreserve(t->journal_credits);
+  t->journal_credits = 0;
+  lock_acquire(&journal_lock);
+  if (handles > 0 && --handles == 0 && committing)
+    cond_signal(&handles_done, &journal_lock);
+  cond_broadcast(&handle_stopped, &journal_lock);
+  lock_release(&journal_lock);
+}
+
+// 将txn_buf中编号为tid的事务写入日志：先写回上一个事务，再顺序写入描述块和块内容，最后写入提交块
+static void
+write_txn(uint32_t tid, size_t cnt)
+{
+  struct journal_desc *desc = (struct journal_desc *)txn_buf;
+  uint8_t *swap;
+
+  checkpoint();
+
+  desc->magic = JOURNAL_DESC_MAGIC;
+  desc->tid = tid;
+  desc->cnt = cnt;
+  memset(desc->unused, 0, sizeof desc->unused);
+  block_write_multiple(fs_device, JOURNAL_SECTOR + 1, cnt + 1, txn_buf);
+
+  memset(&commit_block, 0, sizeof commit_block);
+  commit_block.magic = JOURNAL_COMMIT_MAGIC;
+  commit_block.tid = tid;
+  commit_block.cnt = cnt;
+  commit_block.checksum = txn_checksum(txn_buf, cnt);
+  block_write(fs_device, JOURNAL_SECTOR + 2 + cnt, &commit_block);
+
+  // 事务已经提交，其中的块可以写回原位置；保留事务的内容用于下一次写入日志前的检查点
+  // 上一个事务不会再被重放，其中释放的扇区可以重新分配
+  cache_journal_done(tid);
+  free_map_committed();
+  swap = ckpt_buf;
+  ckpt_buf = txn_buf;
+  txn_buf = swap;
+  ckpt_cnt = cnt;
+}
+
+void journal_commit(void)
+{
+  struct thread *t = thread_current();
+  struct journal_desc *desc;
+  uint32_t tid;
+  size_t cnt;
+
+  if (!journal_enabled)
+  {
+    free_map_flush();
+    return;
+  }
+
+  // 同一时刻只有一个提交者，其他同时要求提交的线程等待它完成复制即可
+  lock_acquire(&journal_lock);
+  if (committing)
+  {
+    while (committing)
+      cond_wait(&commit_done, &journal_lock);
+    lock_release(&journal_lock);
+    return;
+  }
+  committing = true;
+  while (handles > 0)
+    cond_wait(&handles_done, &journal_lock);
+  lock_release(&journal_lock);
+
+  // 没有进行中的操作，先将空闲扇区位图的修改加入事务，使事务与位图保持一致
+  t->journal_depth++;
+  free_map_flush();
+  t->journal_depth--;
+
+  // 在允许新的操作之前获取journal_io_lock，保证事务按照编号顺序写入日志
+  lock_acquire(&journal_io_lock);
+  desc = (struct journal_desc *)txn_buf;
+  cnt = cache_journal_snapshot(&tid, desc->sectors, txn_buf + BLOCK_SECTOR_SIZE);
+  // 此前释放的扇区属于正在提交的事务，之后释放的扇区属于下一个事务
+  if (cnt > 0)
+    free_map_commit();
+
+  lock_acquire(&journal_lock);
+  committing = false;
+  cond_broadcast(&commit_done, &journal_lock);
+  lock_release(&journal_lock);
+
+  if (cnt > 0)
+    write_txn(tid, cnt);
+  lock_release(&journal_io_lock);
+}
@@ -0,0 +1,30 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+// 元数据日志区域：格式化时在文件系统设备上预留的一段连续扇区
+// 第一个扇区是日志头，其后依次是描述块、事务中各个元数据块的内容和提交块
+#define JOURNAL_SECTOR 2                       // 日志区域的第一个扇区
+#define JOURNAL_SECTORS 64                     // 日志区域的扇区数
+#define JOURNAL_TXN_MAX (JOURNAL_SECTORS - 3)  // 一个事务最多包含的元数据块数
+#define JOURNAL_HANDLE_CREDITS 8               // 每个日志操作预留的块数，足够一次创建、删除或扩展文件使用
+
+// 格式化时预留日志区域并写入日志头，必须在创建空闲扇区位图文件之前调用
+void journal_create(void);
+// 检查日志头并重放最后一个已经提交的事务，然后开始记录日志；没有日志区域的旧磁盘不使用日志
+void journal_init(void);
+// 提交当前事务并将其写回原位置，然后清空日志，此后不再记录日志
+void journal_close(void);
+
+// 开始一次元数据操作，操作中修改的元数据块属于同一个事务，可以嵌套调用
+// 在当前事务中为该操作预留JOURNAL_HANDLE_CREDITS个块，事务剩余的空间不足时先提交事务
+// 必须在获取文件系统的其他锁之前调用，因为可能需要等待正在进行的提交
+void journal_start(void);
+// 结束一次元数据操作
+void journal_stop(void);
+// 将当前事务中的所有元数据块作为一次顺序写入提交到日志中
+void journal_commit(void);
+
+#endif /* filesys/journal.h */
@@ -23,11 +23,20 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Two summary arrays, with one bit per element of BITS, let
+   searches skip whole elements without looking at them: bit I
+   of ONES is set if every bit of element I is set to true, and
+   bit I of ZEROS is set if every bit of element I is set to
+   false.  Only the bits actually used in the last element count
+   toward its summary bits. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *ones;    /* Elements of BITS that are all true. */
+    elem_type *zeros;   /* Elements of BITS that are all false. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -69,6 +78,99 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns the number of bytes required for BIT_CNT bits and
+   their summaries. */
+static inline size_t
+storage_size (size_t bit_cnt)
+{
+  return byte_cnt (bit_cnt) + 2 * byte_cnt (elem_cnt (bit_cnt));
+}
+
+/* Points B's element and summary arrays into STORAGE, which must
+   have room for storage_size(B->bit_cnt) bytes. */
+static void
+set_storage (struct bitmap *b, void *storage)
+{
+  b->bits = storage;
+  b->ones = b->bits + elem_cnt (b->bit_cnt);
+  b->zeros = b->ones + elem_cnt (elem_cnt (b->bit_cnt));
+}
+
+/* Returns element IDX of B with only the bits actually used in
+   B left as they are and the rest turned off. */
+static inline elem_type
+used_bits (const struct bitmap *b, size_t idx)
+{
+  elem_type e = b->bits[idx];
+  return idx == elem_cnt (b->bit_cnt) - 1 ? e & last_mask (b) : e;
+}
+
+/* Returns element IDX of B with the bits that are set to VALUE
+   turned on and all other bits, including the unused bits past
+   the end of B, turned off. */
+static inline elem_type
+value_bits (const struct bitmap *b, size_t idx, bool value)
+{
+  elem_type e = value ? b->bits[idx] : ~b->bits[idx];
+  return idx == elem_cnt (b->bit_cnt) - 1 ? e & last_mask (b) : e;
+}
+
+/* Updates B's summary bits for element IDX after it changed. */
+static void
+update_summary (struct bitmap *b, size_t idx)
+{
+  elem_type full = idx == elem_cnt (b->bit_cnt) - 1 ? last_mask (b)
+                                                    : (elem_type) -1;
+  elem_type e = used_bits (b, idx);
+  elem_type mask = bit_mask (idx);
+
+  if (e == full)
+    b->ones[elem_idx (idx)] |= mask;
+  else
+    b->ones[elem_idx (idx)] &= ~mask;
+  if (e == 0)
+    b->zeros[elem_idx (idx)] |= mask;
+  else
+    b->zeros[elem_idx (idx)] &= ~mask;
+}
+
+/* Returns an elem_type with the bits from bit OFS through bit
+   OFS + CNT - 1 turned on.  OFS + CNT must not exceed
+   ELEM_BITS. */
+static inline elem_type
+range_mask (size_t ofs, size_t cnt)
+{
+  elem_type high = cnt + ofs < ELEM_BITS
+                   ? ((elem_type) 1 << (ofs + cnt)) - 1 : (elem_type) -1;
+  return high & ~(((elem_type) 1 << ofs) - 1);
+}
+
+/* Returns the number of bits set to true in E. */
+static inline size_t
+popcount (elem_type e)
+{
+  size_t cnt = 0;
+  for (; e != 0; e &= e - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Returns the index of the lowest bit set to true in E, which
+   must be nonzero. */
+static inline size_t
+lowest_bit (elem_type e)
+{
+  return __builtin_ctzl (e);
+}
+
+/* Returns the number of consecutive bits set to true at the top
+   of E, which must not have every bit set. */
+static inline size_t
+leading_ones (elem_type e)
+{
+  return __builtin_clzl (~e);
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -81,9 +183,11 @@ bitmap_create (size_t bit_cnt)
   struct bitmap *b = malloc (sizeof *b);
   if (b != NULL)
     {
+      void *storage = malloc (storage_size (bit_cnt));
+
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
-      if (b->bits != NULL || bit_cnt == 0)
+      set_storage (b, storage);
+      if (storage != NULL || bit_cnt == 0)
         {
           bitmap_set_all (b, false);
           return b;
@@ -104,7 +208,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
-  b->bits = (elem_type *) (b + 1);
+  set_storage (b, b + 1);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +218,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + storage_size (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -152,7 +256,10 @@ bitmap_set (struct bitmap *b, size_t idx, bool value)
     bitmap_reset (b, idx);
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to true. */
+/* Atomically sets the bit numbered BIT_IDX in B to true.
+   (Only the bit itself is updated atomically.  Keeping B's
+   summary bits consistent requires external synchronization
+   between threads that modify the same bitmap.) */
 void
 bitmap_mark (struct bitmap *b, size_t bit_idx) 
 {
@@ -163,6 +270,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -176,6 +284,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -191,6 +300,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -213,52 +323,80 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Works an element at a time. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (cnt > 0)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+      elem_type mask = range_mask (ofs, n);
+
+      if (value)
+        b->bits[idx] |= mask;
+      else
+        b->bits[idx] &= ~mask;
+      update_summary (b, idx);
+
+      start += n;
+      cnt -= n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
-   exclusive, that are set to VALUE. */
+   exclusive, that are set to VALUE.  Works an element at a
+   time. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (cnt > 0)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+
+      value_cnt += popcount (value_bits (b, idx, value) & range_mask (ofs, n));
+      start += n;
+      cnt -= n;
+    }
   return value_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
-   exclusive, are set to VALUE, and false otherwise. */
+   exclusive, are set to VALUE, and false otherwise.  Works an
+   element at a time. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
+  while (cnt > 0)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+
+      if (value_bits (b, idx, value) & range_mask (ofs, n))
+        return true;
+      start += n;
+      cnt -= n;
+    }
   return false;
 }
 
@@ -288,27 +426,145 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Returns the index of the first element of B at or after IDX
+   that has at least one bit set to VALUE, or the number of
+   elements in B if there is none.  Uses the summary bits to skip
+   ELEM_BITS elements at a time. */
+static size_t
+next_elem (const struct bitmap *b, size_t idx, bool value)
+{
+  const elem_type *skip = value ? b->zeros : b->ones;
+  size_t elem_total = elem_cnt (b->bit_cnt);
+
+  while (idx < elem_total)
+    {
+      elem_type s = ~skip[elem_idx (idx)] & ~(bit_mask (idx) - 1);
+      if (s != 0)
+        {
+          idx = elem_idx (idx) * ELEM_BITS + lowest_bit (s);
+          return idx < elem_total ? idx : elem_total;
+        }
+      idx = (elem_idx (idx) + 1) * ELEM_BITS;
+    }
+  return elem_total;
+}
+
+/* Returns an elem_type in which bit I is turned on if bits I
+   through I + CNT - 1 of E are all turned on.  CNT must be
+   between 1 and ELEM_BITS. */
+static inline elem_type
+run_starts (elem_type e, size_t cnt)
+{
+  size_t n = 1;
+  while (n < cnt && e != 0)
+    {
+      size_t shift = n < cnt - n ? n : cnt - n;
+      e &= e >> shift;
+      n += shift;
+    }
+  return e;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Examines B an element at a time, skipping elements with no
+   bits set to VALUE by way of the summary bits, so the search
+   takes time roughly proportional to the number of elements
+   rather than to the number of bits times CNT. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t elem_total, idx;
+  size_t run_start = 0, run_len = 0;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 0)
+    return start;
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+
+  elem_total = elem_cnt (b->bit_cnt);
+  for (idx = elem_idx (start); idx < elem_total; idx++)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t base;
+      elem_type e;
+
+      /* Without a run in progress, elements with no bits set
+         to VALUE cannot contribute to a group. */
+      if (run_len == 0)
+        {
+          size_t next = next_elem (b, idx, value);
+          if (next >= elem_total)
+            break;
+          idx = next;
+        }
+
+      base = idx * ELEM_BITS;
+      e = value_bits (b, idx, value);
+      if (base < start)
+        e &= ~(((elem_type) 1 << (start - base)) - 1);
+
+      if (e == (elem_type) -1)
+        {
+          if (run_len == 0)
+            run_start = base;
+          run_len += ELEM_BITS;
+        }
+      else
+        {
+          /* A run continued from previous elements. */
+          if (run_len > 0 && run_len + lowest_bit (~e) >= cnt)
+            return run_start;
+
+          /* A run entirely within this element. */
+          if (cnt <= ELEM_BITS)
+            {
+              elem_type starts = run_starts (e, cnt);
+              if (starts != 0)
+                return base + lowest_bit (starts);
+            }
+
+          /* A run that starts here and may continue into the next
+             element. */
+          run_len = leading_ones (e);
+          run_start = base + ELEM_BITS - run_len;
+        }
+
+      if (run_len >= cnt)
+        return run_start;
     }
   return BITMAP_ERROR;
 }
 
+/* Like bitmap_scan(), but starts searching at *CURSOR instead of
+   a fixed index and, if no group is found between there and the
+   end of B, wraps around and searches again from the beginning.
+   On success, advances *CURSOR past the group that was found, so
+   that repeated calls allocate from B in next-fit order without
+   rescanning a prefix that is already in use. */
+size_t
+bitmap_scan_next (const struct bitmap *b, size_t *cursor, size_t cnt,
+                  bool value)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+  ASSERT (cursor != NULL);
+
+  if (*cursor > b->bit_cnt)
+    *cursor = 0;
+  idx = bitmap_scan (b, *cursor, cnt, value);
+  if (idx == BITMAP_ERROR && *cursor > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR)
+    *cursor = idx + cnt;
+  return idx;
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
@@ -325,6 +581,18 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
   return idx;
 }
 
+/* Like bitmap_scan_and_flip(), but searches in next-fit order
+   starting at *CURSOR, as bitmap_scan_next() does. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t *cursor, size_t cnt,
+                           bool value)
+{
+  size_t idx = bitmap_scan_next (b, cursor, cnt, value);
+  if (idx != BITMAP_ERROR) 
+    bitmap_set_multiple (b, idx, cnt, !value);
+  return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -344,8 +612,12 @@ bitmap_read (struct bitmap *b, struct file *file)
   if (b->bit_cnt > 0) 
     {
       off_t size = byte_cnt (b->bit_cnt);
+      size_t i;
+
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+        update_summary (b, i);
     }
   return success;
 }
@@ -358,6 +630,32 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B that holds the CNT bits starting at START
+   to FILE, at the same offset at which bitmap_write() would
+   write it.  Whole elements are written, so the bytes written
+   may cover a few bits outside the range.  Returns true if
+   successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  size_t first, last;
+  off_t ofs, size;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+
+  if (cnt == 0)
+    return true;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  ofs = first * sizeof (elem_type);
+  size = (last - first + 1) * sizeof (elem_type);
+  return file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+         == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -28,7 +28,12 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_DUP,                    /* Duplicates a file descriptor. */
+    SYS_DUP2,                   /* Duplicates a fd onto a given number. */
+    SYS_RING_ENTER              /* Runs queued calls from a syscall ring. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,47 @@
+#ifndef __LIB_SYSCALL_RING_H
+#define __LIB_SYSCALL_RING_H
+
+#include <stdint.h>
+
+/* Number of entries in each queue of a system call ring.
+   Must be a power of 2. */
+#define SYSCALL_RING_SIZE 64
+
+/* A queued system call.  NUMBER is SYS_CREATE, SYS_REMOVE,
+   SYS_OPEN, SYS_FILESIZE, SYS_READ, SYS_WRITE, SYS_SEEK,
+   SYS_TELL, or SYS_CLOSE, and ARGS are its arguments in the
+   order the direct call takes them.  USER_DATA is copied to the
+   matching completion unchanged. */
+struct ring_sqe
+  {
+    int number;                 /* System call number. */
+    int args[3];                /* Arguments. */
+    uint32_t user_data;         /* Identifies the call to its owner. */
+  };
+
+/* A completed system call. */
+struct ring_cqe
+  {
+    uint32_t user_data;         /* From the submission. */
+    int result;                 /* Return value, -1 if not allowed. */
+  };
+
+/* Submission and completion queues in user memory.
+
+   Heads and tails count entries without wrapping; entry I lives
+   at index I % SYSCALL_RING_SIZE.  The program fills sq[] and
+   advances sq_tail, and consumes cq[] and advances cq_head.  The
+   kernel executes submissions in order during ring_enter(),
+   advancing sq_head and cq_tail, and stops early when the
+   completion queue is full. */
+struct syscall_ring
+  {
+    uint32_t sq_head;           /* Next submission the kernel runs. */
+    uint32_t sq_tail;           /* Next free submission slot. */
+    uint32_t cq_head;           /* Next completion to consume. */
+    uint32_t cq_tail;           /* Next free completion slot. */
+    struct ring_sqe sq[SYSCALL_RING_SIZE];  /* Submission queue. */
+    struct ring_cqe cq[SYSCALL_RING_SIZE];  /* Completion queue. */
+  };
+
+#endif /* lib/syscall-ring.h */
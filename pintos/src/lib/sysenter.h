@@ -0,0 +1,29 @@
+#ifndef __LIB_SYSENTER_H
+#define __LIB_SYSENTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Returns true if the processor implements the SYSENTER and
+   SYSEXIT instructions.  The kernel only programs the SYSENTER
+   MSRs when this returns true, and passes its decision to user
+   programs, which must not check this themselves. */
+static inline bool
+sysenter_supported (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  uint32_t family, model, stepping;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  family = (eax >> 8) & 0xf;
+  model = (eax >> 4) & 0xf;
+  stepping = eax & 0xf;
+
+  /* Early Pentium Pro processors report SEP in CPUID but do not
+     actually support the instructions. */
+  if (family == 6 && model < 3 && stepping < 3)
+    return false;
+  return (edx & (1u << 11)) != 0;
+}
+
+#endif /* lib/sysenter.h */
@@ -1,10 +1,13 @@
 #include <syscall.h>
 
 int main (int, char *[]);
-void _start (int argc, char *argv[]);
+void _start (int argc, char *argv[], int sysenter);
 
+/* The kernel passes SYSENTER nonzero if system calls may enter
+   through SYSENTER. */
 void
-_start (int argc, char *argv[]) 
+_start (int argc, char *argv[], int sysenter) 
 {
+  syscall_sysenter = sysenter != 0;
   exit (main (argc, argv));
 }
@@ -1,9 +1,9 @@
 #include <syscall.h>
 #include "../syscall-nr.h"
 
-/* Invokes syscall NUMBER, passing no arguments, and returns the
-   return value as an `int'. */
-#define syscall0(NUMBER)                                        \
+/* Invokes syscall NUMBER through "int $0x30", passing no
+   arguments, and returns the return value as an `int'. */
+#define int_syscall0(NUMBER)                                    \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
@@ -14,9 +14,9 @@
           retval;                                               \
         })
 
-/* Invokes syscall NUMBER, passing argument ARG0, and returns the
-   return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                           \
+/* Invokes syscall NUMBER through "int $0x30", passing argument
+   ARG0, and returns the return value as an `int'. */
+#define int_syscall1(NUMBER, ARG0)                                       \
         ({                                                               \
           int retval;                                                    \
           asm volatile                                                   \
@@ -28,9 +28,9 @@
           retval;                                                        \
         })
 
-/* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
-   returns the return value as an `int'. */
-#define syscall2(NUMBER, ARG0, ARG1)                            \
+/* Invokes syscall NUMBER through "int $0x30", passing arguments
+   ARG0 and ARG1, and returns the return value as an `int'. */
+#define int_syscall2(NUMBER, ARG0, ARG1)                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
@@ -44,9 +44,10 @@
           retval;                                               \
         })
 
-/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, and
-   ARG2, and returns the return value as an `int'. */
-#define syscall3(NUMBER, ARG0, ARG1, ARG2)                      \
+/* Invokes syscall NUMBER through "int $0x30", passing arguments
+   ARG0, ARG1, and ARG2, and returns the return value as an
+   `int'. */
+#define int_syscall3(NUMBER, ARG0, ARG1, ARG2)                  \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
@@ -61,6 +62,48 @@
           retval;                                               \
         })
 
+/* True if system calls enter the kernel through SYSENTER, false
+   if through "int $0x30".  Set by _start() from what the kernel
+   passes it. */
+bool syscall_sysenter;
+
+/* Invokes syscall NUMBER through SYSENTER, passing ARG0, ARG1,
+   and ARG2 in %ebx, %edi, and %esi, and returns the return value
+   as an `int'.  The kernel resumes at label 1 with the stack
+   pointer saved in %ecx. */
+static inline int
+fast_syscall (int number, int arg0, int arg1, int arg2)
+{
+  int retval;
+  asm volatile
+    ("movl %%esp, %%ecx; movl $1f, %%edx; sysenter; 1:"
+       : "=a" (retval)
+       : "a" (number), "b" (arg0), "D" (arg1), "S" (arg2)
+       : "ecx", "edx", "cc", "memory");
+  return retval;
+}
+
+/* Invokes syscall NUMBER with the given arguments through
+   SYSENTER if the kernel allows it, otherwise through "int $0x30", and
+   returns the return value as an `int'. */
+#define syscall0(NUMBER)                                        \
+        (syscall_sysenter                                       \
+         ? fast_syscall (NUMBER, 0, 0, 0)                       \
+         : int_syscall0 (NUMBER))
+#define syscall1(NUMBER, ARG0)                                  \
+        (syscall_sysenter                                       \
+         ? fast_syscall (NUMBER, (int) (ARG0), 0, 0)            \
+         : int_syscall1 (NUMBER, ARG0))
+#define syscall2(NUMBER, ARG0, ARG1)                            \
+        (syscall_sysenter                                       \
+         ? fast_syscall (NUMBER, (int) (ARG0), (int) (ARG1), 0) \
+         : int_syscall2 (NUMBER, ARG0, ARG1))
+#define syscall3(NUMBER, ARG0, ARG1, ARG2)                      \
+        (syscall_sysenter                                       \
+         ? fast_syscall (NUMBER, (int) (ARG0), (int) (ARG1),    \
+                         (int) (ARG2))                          \
+         : int_syscall3 (NUMBER, ARG0, ARG1, ARG2))
+
 void
 halt (void) 
 {
@@ -183,3 +226,64 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+dup (int fd)
+{
+  return syscall1 (SYS_DUP, fd);
+}
+
+int
+dup2 (int oldfd, int newfd)
+{
+  return syscall2 (SYS_DUP2, oldfd, newfd);
+}
+
+/* Empties RING. */
+void
+ring_init (struct syscall_ring *ring)
+{
+  ring->sq_head = ring->sq_tail = 0;
+  ring->cq_head = ring->cq_tail = 0;
+}
+
+/* Queues system call NUMBER with arguments ARG0, ARG1, and ARG2
+   in RING, to run at the next ring_enter().  Returns false if the
+   submission queue is full. */
+bool
+ring_queue (struct syscall_ring *ring, int number, int arg0, int arg1,
+            int arg2, uint32_t user_data)
+{
+  struct ring_sqe *sqe;
+
+  if (ring->sq_tail - ring->sq_head >= SYSCALL_RING_SIZE)
+    return false;
+  sqe = &ring->sq[ring->sq_tail % SYSCALL_RING_SIZE];
+  sqe->number = number;
+  sqe->args[0] = arg0;
+  sqe->args[1] = arg1;
+  sqe->args[2] = arg2;
+  sqe->user_data = user_data;
+  ring->sq_tail++;
+  return true;
+}
+
+/* Removes the oldest completion from RING into *CQE.  Returns
+   false if there is none. */
+bool
+ring_reap (struct syscall_ring *ring, struct ring_cqe *cqe)
+{
+  if (ring->cq_head == ring->cq_tail)
+    return false;
+  *cqe = ring->cq[ring->cq_head % SYSCALL_RING_SIZE];
+  ring->cq_head++;
+  return true;
+}
+
+/* Runs up to TO_SUBMIT queued system calls from RING in one
+   trap and returns how many ran. */
+int
+ring_enter (struct syscall_ring *ring, unsigned to_submit)
+{
+  return syscall2 (SYS_RING_ENTER, ring, to_submit);
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <syscall-ring.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -15,6 +16,10 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* True if system calls enter the kernel through SYSENTER.  The
+   kernel decides and tells the program at startup. */
+extern bool syscall_sysenter;
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -45,4 +50,13 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int dup (int fd);
+int dup2 (int oldfd, int newfd);
+void ring_init (struct syscall_ring *);
+bool ring_queue (struct syscall_ring *, int number, int arg0, int arg1,
+                 int arg2, uint32_t user_data);
+bool ring_reap (struct syscall_ring *, struct ring_cqe *);
+int ring_enter (struct syscall_ring *, unsigned to_submit);
+
 #endif /* lib/user/syscall.h */
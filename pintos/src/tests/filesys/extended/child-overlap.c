@@ -0,0 +1,56 @@
+/* Child process for syn-overlap.
+   Writes its own chunk of the file created by our parent
+   process, interleaved with writes to a range that overlaps the
+   ranges written by the other children. */
+
+#include <random.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-overlap.h"
+#include "tests/lib.h"
+
+static char buf[FILE_SIZE];
+
+/* Writes SIZE bytes of BUF at offset OFS in FD. */
+static void
+write_range (int fd, size_t ofs, size_t size) 
+{
+  int bytes_written;
+
+  seek (fd, ofs);
+  bytes_written = write (fd, buf + ofs, size);
+  if (bytes_written != (int) size)
+    fail ("write %zu bytes at offset %zu in \"%s\" returned %d",
+          size, ofs, file_name, bytes_written);
+}
+
+int
+main (int argc, const char *argv[]) 
+{
+  int child_idx;
+  size_t ofs;
+  int fd;
+
+  test_name = "child-overlap";
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < CHUNK_SIZE; ofs += PIECE_SIZE)
+    {
+      size_t size = CHUNK_SIZE - ofs;
+
+      if (size > PIECE_SIZE)
+        size = PIECE_SIZE;
+      write_range (fd, child_idx * CHUNK_SIZE + ofs, size);
+      write_range (fd, SHARED_OFS + child_idx * SHARED_STEP, SHARED_SIZE);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($data) = join ('', map (chr (ord ('a') + $_ % 26), 0...5999));
+check_archive ({'a' => {'b' => [$data]},
+		'c' => [substr ($data, 0, 100)]});
+pass;
@@ -0,0 +1,45 @@
+/* Creates a directory and files, writes and closes them, and
+   removes one of them, then halts.  The kernel runs with
+   -halt-crash, so halt commits the metadata journal but powers
+   off before the journaled sectors reach their home locations,
+   as if the machine lost power.  The files are only intact in
+   the persistence check if the next boot replays the journal. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[6000];
+
+static void
+write_file (const char *name, size_t size) 
+{
+  int fd;
+
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  CHECK (write (fd, buf, size) == (int) size,
+         "write %zu bytes to \"%s\"", size, name);
+  msg ("close \"%s\"", name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = 'a' + i % 26;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  write_file ("a/b", sizeof buf);
+  write_file ("c", 100);
+  write_file ("d", 2000);
+  CHECK (remove ("d"), "remove \"d\"");
+
+  msg ("halt");
+  halt ();
+  fail ("should have halted");
+}
@@ -0,0 +1,35 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@expected) = split ("\n", <<'EOF');
+(crash-replay) begin
+(crash-replay) mkdir "a"
+(crash-replay) create "a/b"
+(crash-replay) open "a/b"
+(crash-replay) write 6000 bytes to "a/b"
+(crash-replay) close "a/b"
+(crash-replay) create "c"
+(crash-replay) open "c"
+(crash-replay) write 100 bytes to "c"
+(crash-replay) close "c"
+(crash-replay) create "d"
+(crash-replay) open "d"
+(crash-replay) write 2000 bytes to "d"
+(crash-replay) close "d"
+(crash-replay) remove "d"
+(crash-replay) halt
+EOF
+my (@actual) = grep (/^\(crash-replay\) /, @output);
+fail "expected output:\n", map ("  $_\n", @expected),
+  "actual output:\n", map ("  $_\n", @actual)
+  if join ("\n", @actual) ne join ("\n", @expected);
+fail "process exited--halt didn't really halt\n"
+  if grep (/^crash-replay: exit\(/, @output);
+pass;
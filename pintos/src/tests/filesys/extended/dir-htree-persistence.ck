@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($big) = {};
+$big->{"f$_"} = [''] foreach grep ($_ % 2 == 0 || $_ >= 1600, 0...1699);
+check_archive ({'big' => $big});
+pass;
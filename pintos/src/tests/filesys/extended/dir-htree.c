@@ -0,0 +1,111 @@
+/* Creates enough files in one directory for its hashed index to
+   outgrow the root index block, so that leaves and then index
+   nodes split and the root gains a level of index nodes.  Checks
+   that readdir returns every file exactly once, removes every
+   other file, checks readdir again, and then creates more files
+   in the space that the removals freed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 1600
+#define EXTRA_CNT 100
+
+static bool present[FILE_CNT + EXTRA_CNT];
+
+/* Creates "big/fN" and records that it exists. */
+static void
+make_file (int n) 
+{
+  char name[32];
+
+  snprintf (name, sizeof name, "big/f%d", n);
+  CHECK (create (name, 0), "create \"%s\"", name);
+  present[n] = true;
+}
+
+/* Removes "big/fN" and records that it no longer exists. */
+static void
+remove_file (int n) 
+{
+  char name[32];
+
+  snprintf (name, sizeof name, "big/f%d", n);
+  CHECK (remove (name), "remove \"%s\"", name);
+  present[n] = false;
+}
+
+/* Checks that readdir on "big" returns exactly the files
+   recorded in PRESENT, each one once. */
+static void
+check_dir (void) 
+{
+  static bool seen[FILE_CNT + EXTRA_CNT];
+  char name[READDIR_MAX_LEN + 1];
+  int fd, n, cnt, expected;
+
+  memset (seen, 0, sizeof seen);
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+  for (cnt = 0; readdir (fd, name); cnt++)
+    {
+      n = atoi (name + 1);
+      if (name[0] != 'f' || n < 0 || n >= FILE_CNT + EXTRA_CNT
+          || !present[n])
+        fail ("readdir returned unexpected \"%s\"", name);
+      if (seen[n])
+        fail ("readdir returned \"%s\" twice", name);
+      seen[n] = true;
+    }
+  close (fd);
+
+  for (n = expected = 0; n < FILE_CNT + EXTRA_CNT; n++)
+    expected += present[n];
+  if (cnt != expected)
+    fail ("readdir returned %d entries, expected %d", cnt, expected);
+  msg ("readdir \"big\" returned %d entries", cnt);
+}
+
+void
+test_main (void) 
+{
+  int n;
+
+  CHECK (mkdir ("big"), "mkdir \"big\"");
+
+  quiet = true;
+  for (n = 0; n < FILE_CNT; n++)
+    make_file (n);
+  quiet = false;
+  msg ("created %d files", FILE_CNT);
+  check_dir ();
+
+  quiet = true;
+  for (n = 1; n < FILE_CNT; n += 2)
+    remove_file (n);
+  quiet = false;
+  msg ("removed %d files", FILE_CNT / 2);
+  check_dir ();
+
+  quiet = true;
+  for (n = FILE_CNT; n < FILE_CNT + EXTRA_CNT; n++)
+    make_file (n);
+  for (n = 0; n < FILE_CNT + EXTRA_CNT; n++)
+    {
+      char name[32];
+      int fd;
+
+      snprintf (name, sizeof name, "big/f%d", n);
+      fd = open (name);
+      if (present[n] ? fd < 2 : fd != -1)
+        fail ("open \"%s\" returned %d", name, fd);
+      if (fd > 1)
+        close (fd);
+    }
+  quiet = false;
+  msg ("created %d more files", EXTRA_CNT);
+  check_dir ();
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dir-htree) begin
+(dir-htree) mkdir "big"
+(dir-htree) created 1600 files
+(dir-htree) open "big"
+(dir-htree) readdir "big" returned 1600 entries
+(dir-htree) removed 800 files
+(dir-htree) open "big"
+(dir-htree) readdir "big" returned 800 entries
+(dir-htree) created 100 more files
+(dir-htree) open "big"
+(dir-htree) readdir "big" returned 900 entries
+(dir-htree) end
+dir-htree: exit(0)
+EOF
+pass;
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($data) = "\0" x 70001;
+substr ($data, 40000, 512) = "b" x 512;
+substr ($data, 10000, 100) = "a" x 100;
+substr ($data, 70000, 1) = "c";
+substr ($data, 20000, 1000) = "d" x 1000;
+check_archive ({"testfile" => [$data]});
+pass;
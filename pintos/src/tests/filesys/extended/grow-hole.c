@@ -0,0 +1,37 @@
+/* Tests that writing into the middle of a hole left by seeking
+   past the end of a file keeps the rest of the hole zeroed, both
+   before and after the newly written bytes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[70001];
+
+static void
+write_at (int fd, const char *file_name, size_t ofs, char c, size_t size)
+{
+  memset (buf + ofs, c, size);
+  msg ("seek \"%s\" to %zu", file_name, ofs);
+  seek (fd, ofs);
+  CHECK (write (fd, buf + ofs, size) == (int) size,
+         "write %zu bytes to \"%s\"", size, file_name);
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  int fd;
+  
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  write_at (fd, file_name, 40000, 'b', 512);
+  write_at (fd, file_name, 10000, 'a', 100);
+  write_at (fd, file_name, 70000, 'c', 1);
+  write_at (fd, file_name, 20000, 'd', 1000);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
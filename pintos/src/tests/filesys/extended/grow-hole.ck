@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-hole) begin
+(grow-hole) create "testfile"
+(grow-hole) open "testfile"
+(grow-hole) seek "testfile" to 40000
+(grow-hole) write 512 bytes to "testfile"
+(grow-hole) seek "testfile" to 10000
+(grow-hole) write 100 bytes to "testfile"
+(grow-hole) seek "testfile" to 70000
+(grow-hole) write 1 bytes to "testfile"
+(grow-hole) seek "testfile" to 20000
+(grow-hole) write 1000 bytes to "testfile"
+(grow-hole) close "testfile"
+(grow-hole) open "testfile" for verification
+(grow-hole) verified contents of "testfile"
+(grow-hole) close "testfile"
+(grow-hole) end
+EOF
+pass;
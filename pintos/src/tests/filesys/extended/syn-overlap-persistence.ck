@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (4 * 2048 + 100 + 3 * 300 + 1000);
+substr ($data, 4 * 2048, 100) = "\0" x 100;
+check_archive ({"child-overlap" => "tests/filesys/extended/child-overlap",
+		"overlap" => [$data]});
+pass;
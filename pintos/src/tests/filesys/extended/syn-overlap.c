@@ -0,0 +1,28 @@
+/* Several subprocesses write disjoint and overlapping ranges of
+   one file at the same time, extending it as they go.  None of
+   the writes may come up short, and the final contents must be
+   exactly what the writes put there. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-overlap.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+
+  exec_children ("child-overlap", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+
+  random_bytes (buf, sizeof buf);
+  memset (buf + CHILD_CNT * CHUNK_SIZE, 0, GAP_SIZE);
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-overlap) begin
+(syn-overlap) create "overlap"
+(syn-overlap) exec child 1 of 4: "child-overlap 0"
+(syn-overlap) exec child 2 of 4: "child-overlap 1"
+(syn-overlap) exec child 3 of 4: "child-overlap 2"
+(syn-overlap) exec child 4 of 4: "child-overlap 3"
+(syn-overlap) wait for child 1 of 4 returned 0 (expected 0)
+(syn-overlap) wait for child 2 of 4 returned 1 (expected 1)
+(syn-overlap) wait for child 3 of 4 returned 2 (expected 2)
+(syn-overlap) wait for child 4 of 4 returned 3 (expected 3)
+(syn-overlap) open "overlap" for verification
+(syn-overlap) verified contents of "overlap"
+(syn-overlap) close "overlap"
+(syn-overlap) end
+EOF
+pass;
@@ -0,0 +1,23 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_OVERLAP_H
+#define TESTS_FILESYS_EXTENDED_SYN_OVERLAP_H
+
+/* Each child writes its own CHUNK_SIZE bytes at offset
+   CHILD_IDX * CHUNK_SIZE, PIECE_SIZE bytes at a time.  Between
+   pieces it also writes SHARED_SIZE bytes at SHARED_OFS +
+   CHILD_IDX * SHARED_STEP, which overlaps the shared ranges of
+   the other children and extends the file.  Every write copies
+   the same random data for its range, so the final contents do
+   not depend on the order of the writes.  The GAP_SIZE bytes
+   between the children's chunks and the shared ranges are never
+   written. */
+#define CHILD_CNT 4
+#define CHUNK_SIZE 2048
+#define PIECE_SIZE 100
+#define GAP_SIZE 100
+#define SHARED_OFS (CHILD_CNT * CHUNK_SIZE + GAP_SIZE)
+#define SHARED_STEP 300
+#define SHARED_SIZE 1000
+#define FILE_SIZE (SHARED_OFS + (CHILD_CNT - 1) * SHARED_STEP + SHARED_SIZE)
+static const char file_name[] = "overlap";
+
+#endif /* tests/filesys/extended/syn-overlap.h */
@@ -0,0 +1,29 @@
+/* Passes invalid file descriptors to dup and dup2, which must
+   either fail with -1 or terminate the process with exit code
+   -1.  A valid descriptor must not be duplicated onto the
+   console or onto a negative descriptor. */
+
+#include <limits.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  if (dup (0x20101234) != -1 || dup (5) != -1 || dup (1234) != -1
+      || dup (-1) != -1 || dup (INT_MIN) != -1 || dup (INT_MAX) != -1)
+    fail ("dup of a bad fd succeeded");
+  if (dup2 (-1, handle) != -1 || dup2 (1234, handle) != -1
+      || dup2 (INT_MAX, handle) != -1)
+    fail ("dup2 of a bad fd succeeded");
+  if (dup2 (handle, -1) != -1 || dup2 (handle, INT_MIN) != -1
+      || dup2 (handle, INT_MAX) != -1
+      || dup2 (handle, 0) != -1 || dup2 (handle, 1) != -1)
+    fail ("dup2 onto a bad fd succeeded");
+  msg ("bad fds rejected");
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(dup-bad-fd) begin
+(dup-bad-fd) open "sample.txt"
+(dup-bad-fd) bad fds rejected
+(dup-bad-fd) end
+dup-bad-fd: exit(0)
+EOF
+(dup-bad-fd) begin
+(dup-bad-fd) open "sample.txt"
+dup-bad-fd: exit(-1)
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Duplicates a file descriptor and closes the original, then
+   duplicates it again and closes the copy.  The descriptor left
+   open must still read the file each time, and a descriptor and
+   its copy must share one file position. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle, copy;
+  char buf[10];
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((copy = dup (handle)) > 1, "dup \"sample.txt\"");
+  if (copy == handle)
+    fail ("dup() returned the original descriptor %d", handle);
+
+  CHECK (read (handle, buf, sizeof buf) == sizeof buf,
+         "read \"sample.txt\" through the original");
+  if (tell (copy) != sizeof buf)
+    fail ("position through the copy is %u, not %zu",
+          tell (copy), sizeof buf);
+
+  msg ("close the original");
+  close (handle);
+  seek (copy, 0);
+  check_file_handle (copy, "sample.txt", sample, sizeof sample - 1);
+
+  CHECK ((handle = dup (copy)) > 1, "dup \"sample.txt\" again");
+  msg ("close the copy");
+  close (copy);
+  seek (handle, 0);
+  check_file_handle (handle, "sample.txt", sample, sizeof sample - 1);
+  close (handle);
+}
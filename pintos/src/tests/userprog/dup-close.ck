@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup-close) begin
+(dup-close) open "sample.txt"
+(dup-close) dup "sample.txt"
+(dup-close) read "sample.txt" through the original
+(dup-close) close the original
+(dup-close) verified contents of "sample.txt"
+(dup-close) dup "sample.txt" again
+(dup-close) close the copy
+(dup-close) verified contents of "sample.txt"
+(dup-close) end
+dup-close: exit(0)
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Duplicates one descriptor until the process holds more file
+   descriptors than fit in the initial descriptor table, which
+   must grow.  Every copy must be distinct and read the file, and
+   dup2 must reach a descriptor beyond the old table size. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define COPY_CNT 40
+
+void
+test_main (void) 
+{
+  int handle, copies[COPY_CNT];
+  int i, j;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  for (i = 0; i < COPY_CNT; i++)
+    {
+      copies[i] = dup (handle);
+      if (copies[i] < 2)
+        fail ("dup #%d returned %d", i, copies[i]);
+      for (j = 0; j < i; j++)
+        if (copies[j] == copies[i])
+          fail ("dup #%d and #%d both returned %d", j, i, copies[i]);
+    }
+  msg ("dup %d times", COPY_CNT);
+
+  seek (handle, 0);
+  check_file_handle (copies[COPY_CNT - 1], "sample.txt",
+                     sample, sizeof sample - 1);
+
+  CHECK (dup2 (handle, 100) == 100, "dup2 onto fd 100");
+  seek (100, 0);
+  check_file_handle (100, "sample.txt", sample, sizeof sample - 1);
+
+  for (i = 0; i < COPY_CNT; i++)
+    close (copies[i]);
+  close (100);
+  msg ("close all copies");
+  seek (handle, 0);
+  check_file_handle (handle, "sample.txt", sample, sizeof sample - 1);
+  close (handle);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup-many) begin
+(dup-many) open "sample.txt"
+(dup-many) dup 40 times
+(dup-many) verified contents of "sample.txt"
+(dup-many) dup2 onto fd 100
+(dup-many) verified contents of "sample.txt"
+(dup-many) close all copies
+(dup-many) verified contents of "sample.txt"
+(dup-many) end
+dup-many: exit(0)
+EOF
+pass;
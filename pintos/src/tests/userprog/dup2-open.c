@@ -0,0 +1,35 @@
+/* Opens "sample.txt" twice and uses dup2 to make the second
+   descriptor refer to the first one's open file.  dup2 must
+   return the target descriptor, and reading through either
+   descriptor must then advance a shared file position. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int h1, h2;
+  char buf[10];
+
+  CHECK ((h1 = open ("sample.txt")) > 1, "open \"sample.txt\" once");
+  CHECK ((h2 = open ("sample.txt")) > 1, "open \"sample.txt\" again");
+  CHECK (read (h2, buf, sizeof buf) == sizeof buf,
+         "read \"sample.txt\" through the second descriptor");
+
+  CHECK (dup2 (h1, h2) == h2, "dup2 onto the second descriptor");
+  if (tell (h2) != 0)
+    fail ("second descriptor kept its old position %u", tell (h2));
+  CHECK (read (h1, buf, sizeof buf) == sizeof buf,
+         "read \"sample.txt\" through the first descriptor");
+  if (tell (h2) != sizeof buf)
+    fail ("position through the second descriptor is %u, not %zu",
+          tell (h2), sizeof buf);
+
+  close (h1);
+  seek (h2, 0);
+  check_file_handle (h2, "sample.txt", sample, sizeof sample - 1);
+  close (h2);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup2-open) begin
+(dup2-open) open "sample.txt" once
+(dup2-open) open "sample.txt" again
+(dup2-open) read "sample.txt" through the second descriptor
+(dup2-open) dup2 onto the second descriptor
+(dup2-open) read "sample.txt" through the first descriptor
+(dup2-open) verified contents of "sample.txt"
+(dup2-open) end
+dup2-open: exit(0)
+EOF
+pass;
@@ -0,0 +1,18 @@
+/* Calls dup2 with the same descriptor as source and target,
+   which must return that descriptor and leave it open. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (dup2 (handle, handle) == handle, "dup2 \"sample.txt\" onto itself");
+  check_file_handle (handle, "sample.txt", sample, sizeof sample - 1);
+  close (handle);
+}
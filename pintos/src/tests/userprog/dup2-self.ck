@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup2-self) begin
+(dup2-self) open "sample.txt"
+(dup2-self) dup2 "sample.txt" onto itself
+(dup2-self) verified contents of "sample.txt"
+(dup2-self) end
+dup2-self: exit(0)
+EOF
+pass;
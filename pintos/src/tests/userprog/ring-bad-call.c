@@ -0,0 +1,53 @@
+/* Queues system calls that may not run from a system call ring,
+   among them "halt" and "exit", between two allowed calls.  Each
+   disallowed call must complete with -1 without running, and the
+   allowed calls around them must still run. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const int bad_calls[] =
+  {
+    SYS_HALT, SYS_EXIT, SYS_EXEC, SYS_WAIT, SYS_DUP, SYS_DUP2,
+    SYS_RING_ENTER, SYS_MKDIR, -1, 1000,
+  };
+
+#define BAD_CNT (sizeof bad_calls / sizeof *bad_calls)
+
+void
+test_main (void) 
+{
+  static struct syscall_ring ring;
+  struct ring_cqe cqe;
+  size_t i;
+
+  ring_init (&ring);
+  ring_queue (&ring, SYS_CREATE, (int) "first", 0, 0, 0);
+  for (i = 0; i < BAD_CNT; i++)
+    ring_queue (&ring, bad_calls[i], 0, 0, 0, i + 1);
+  ring_queue (&ring, SYS_CREATE, (int) "last", 0, 0, BAD_CNT + 1);
+  CHECK (ring_enter (&ring, BAD_CNT + 2) == BAD_CNT + 2,
+         "run %zu calls", BAD_CNT + 2);
+
+  for (i = 0; i < BAD_CNT + 2; i++)
+    {
+      if (!ring_reap (&ring, &cqe))
+        fail ("no completion for call %zu", i);
+      if (cqe.user_data != i)
+        fail ("completion for call %u arrived instead of %zu",
+              cqe.user_data, i);
+      if (i == 0 || i == BAD_CNT + 1)
+        {
+          if (cqe.result != 1)
+            fail ("allowed call %zu returned %d", i, cqe.result);
+        }
+      else if (cqe.result != -1)
+        fail ("call number %d returned %d", bad_calls[i - 1], cqe.result);
+    }
+  msg ("disallowed calls returned -1");
+
+  CHECK (open ("first") > 1, "open \"first\"");
+  CHECK (open ("last") > 1, "open \"last\"");
+}
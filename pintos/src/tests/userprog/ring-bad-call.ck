@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-bad-call) begin
+(ring-bad-call) run 12 calls
+(ring-bad-call) disallowed calls returned -1
+(ring-bad-call) open "first"
+(ring-bad-call) open "last"
+(ring-bad-call) end
+ring-bad-call: exit(0)
+EOF
+pass;
@@ -0,0 +1,14 @@
+/* Passes a system call ring at a kernel address to ring_enter.
+   The process must be terminated with exit code -1. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  msg ("ring_enter(0x%08x): %d", 0xc0100000,
+       ring_enter ((struct syscall_ring *) 0xc0100000, 1));
+  fail ("should have called exit(-1)");
+}
@@ -0,0 +1,62 @@
+/* Runs file system calls through a system call ring.  The first
+   batch creates and opens a file; the second writes it, seeks
+   back, reads it, and closes it.  Each call must complete in
+   order, with its own user data and the result the direct call
+   would have returned, or 0 for calls that return nothing. */
+
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct syscall_ring ring;
+
+/* Reaps the next completion from the ring and checks that it
+   belongs to the call queued with USER_DATA.  Returns its
+   result. */
+static int
+reap (uint32_t user_data)
+{
+  struct ring_cqe cqe;
+
+  if (!ring_reap (&ring, &cqe))
+    fail ("no completion for call %u", user_data);
+  if (cqe.user_data != user_data)
+    fail ("completion for call %u arrived instead of %u",
+          cqe.user_data, user_data);
+  return cqe.result;
+}
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int handle, size = sizeof sample - 1;
+  struct ring_cqe cqe;
+
+  ring_init (&ring);
+  ring_queue (&ring, SYS_CREATE, (int) "ring.txt", 0, 0, 1);
+  ring_queue (&ring, SYS_OPEN, (int) "ring.txt", 0, 0, 2);
+  CHECK (ring_enter (&ring, 2) == 2, "run create and open");
+  CHECK (reap (1) == 1, "create \"ring.txt\"");
+  CHECK ((handle = reap (2)) > 1, "open \"ring.txt\"");
+
+  ring_queue (&ring, SYS_WRITE, handle, (int) sample, size, 3);
+  ring_queue (&ring, SYS_SEEK, handle, 0, 0, 4);
+  ring_queue (&ring, SYS_READ, handle, (int) buf, size, 5);
+  ring_queue (&ring, SYS_FILESIZE, handle, 0, 0, 6);
+  ring_queue (&ring, SYS_CLOSE, handle, 0, 0, 7);
+  CHECK (ring_enter (&ring, 5) == 5, "run write, seek, read, and close");
+  CHECK (reap (3) == size, "write \"ring.txt\"");
+  CHECK (reap (4) == 0, "seek \"ring.txt\"");
+  CHECK (reap (5) == size, "read \"ring.txt\"");
+  compare_bytes (buf, sample, size, 0, "ring.txt");
+  CHECK (reap (6) == size, "filesize \"ring.txt\"");
+  CHECK (reap (7) == 0, "close \"ring.txt\"");
+  if (ring_reap (&ring, &cqe))
+    fail ("extra completion for call %u", cqe.user_data);
+
+  check_file ("ring.txt", sample, size);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-batch) begin
+(ring-batch) run create and open
+(ring-batch) create "ring.txt"
+(ring-batch) open "ring.txt"
+(ring-batch) run write, seek, read, and close
+(ring-batch) write "ring.txt"
+(ring-batch) seek "ring.txt"
+(ring-batch) read "ring.txt"
+(ring-batch) filesize "ring.txt"
+(ring-batch) close "ring.txt"
+(ring-batch) open "ring.txt" for verification
+(ring-batch) verified contents of "ring.txt"
+(ring-batch) close "ring.txt"
+(ring-batch) end
+ring-batch: exit(0)
+EOF
+pass;
@@ -0,0 +1,77 @@
+/* Submits more calls than a system call ring holds.  Queuing
+   must fail once the submission queue is full, ring_enter must
+   stop when the completion queue is full, and a ring whose
+   counters claim more entries than it holds must be rejected. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct syscall_ring ring;
+
+/* Queues calls to "tell" on HANDLE until the submission queue is
+   full, numbering them from *NEXT, and returns how many were
+   queued. */
+static int
+fill (int handle, uint32_t *next)
+{
+  int cnt = 0;
+
+  while (ring_queue (&ring, SYS_TELL, handle, 0, 0, *next))
+    {
+      ++*next;
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Reaps every completion, checking that they are numbered from
+   *REAPED upward, and returns how many there were. */
+static int
+drain (uint32_t *reaped)
+{
+  struct ring_cqe cqe;
+  int cnt = 0;
+
+  while (ring_reap (&ring, &cqe))
+    {
+      if (cqe.user_data != *reaped)
+        fail ("completion for call %u arrived instead of %u",
+              cqe.user_data, *reaped);
+      if (cqe.result != 0)
+        fail ("tell returned %d", cqe.result);
+      ++*reaped;
+      cnt++;
+    }
+  return cnt;
+}
+
+void
+test_main (void) 
+{
+  uint32_t next = 0, reaped = 0;
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  ring_init (&ring);
+
+  CHECK (fill (handle, &next) == SYSCALL_RING_SIZE,
+         "queue until the submission queue is full");
+  CHECK (ring_enter (&ring, SYSCALL_RING_SIZE * 2) == SYSCALL_RING_SIZE,
+         "run a full submission queue");
+
+  CHECK (fill (handle, &next) == SYSCALL_RING_SIZE,
+         "queue behind a full completion queue");
+  CHECK (ring_enter (&ring, SYSCALL_RING_SIZE) == 0,
+         "run nothing while the completion queue is full");
+  CHECK (drain (&reaped) == SYSCALL_RING_SIZE, "reap the first batch");
+  CHECK (ring_enter (&ring, SYSCALL_RING_SIZE / 2) == SYSCALL_RING_SIZE / 2,
+         "run half of the second batch");
+  CHECK (ring_enter (&ring, SYSCALL_RING_SIZE) == SYSCALL_RING_SIZE / 2,
+         "run the rest of the second batch");
+  CHECK (drain (&reaped) == SYSCALL_RING_SIZE, "reap the second batch");
+
+  ring.sq_tail = ring.sq_head + SYSCALL_RING_SIZE + 1;
+  CHECK (ring_enter (&ring, 1) == -1, "reject an overfull submission queue");
+}
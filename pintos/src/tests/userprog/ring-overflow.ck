@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-overflow) begin
+(ring-overflow) open "sample.txt"
+(ring-overflow) queue until the submission queue is full
+(ring-overflow) run a full submission queue
+(ring-overflow) queue behind a full completion queue
+(ring-overflow) run nothing while the completion queue is full
+(ring-overflow) reap the first batch
+(ring-overflow) run half of the second batch
+(ring-overflow) run the rest of the second batch
+(ring-overflow) reap the second batch
+(ring-overflow) reject an overfull submission queue
+(ring-overflow) end
+ring-overflow: exit(0)
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Passes invalid and closed file descriptors to filesize,
+   isdir, and inumber, which must either fail (-1, false, -1)
+   or terminate the process with exit code -1. */
+
+#include <limits.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const int bad_fds[] = {0x20101234, 5, 1234, -1, -1024, INT_MIN, INT_MAX};
+
+void
+test_main (void) 
+{
+  size_t i;
+  int handle;
+
+  for (i = 0; i < sizeof bad_fds / sizeof *bad_fds; i++)
+    if (filesize (bad_fds[i]) != -1 || isdir (bad_fds[i])
+        || inumber (bad_fds[i]) != -1)
+      fail ("fd %d was accepted", bad_fds[i]);
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  close (handle);
+  if (filesize (handle) != -1 || isdir (handle) || inumber (handle) != -1)
+    fail ("closed fd %d was accepted", handle);
+  msg ("bad fds rejected");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF', <<'EOF']);
+(size-bad-fd) begin
+(size-bad-fd) open "sample.txt"
+(size-bad-fd) bad fds rejected
+(size-bad-fd) end
+size-bad-fd: exit(0)
+EOF
+(size-bad-fd) begin
+size-bad-fd: exit(-1)
+EOF
+(size-bad-fd) begin
+(size-bad-fd) open "sample.txt"
+size-bad-fd: exit(-1)
+EOF
+pass;
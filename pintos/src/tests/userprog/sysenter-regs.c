@@ -0,0 +1,107 @@
+/* Invokes the "write" system call directly, with known values
+   in every register the caller expects to survive, once through
+   "int $0x30" and, if the kernel allows it, once through
+   SYSENTER.  Both paths must return the number of bytes written
+   in %eax and leave %ebx, %esi, %edi, %ebp, and %esp as they
+   were. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Register contents after a raw system call. */
+struct regs
+  {
+    int eax, ebx, esi, edi, ebp;
+    int esp_before, esp_after;
+  };
+
+/* Value placed in %ebp, which no system call argument uses. */
+#define EBP_MAGIC 0x1badb002
+
+int raw_syscall3 (int fast, int number, int arg0, int arg1, int arg2,
+                  struct regs *);
+
+/* Invokes system call NUMBER with ARG0, ARG1, and ARG2 in %ebx,
+   %edi, and %esi, through SYSENTER if FAST is nonzero and through
+   "int $0x30" otherwise, and stores the registers as they are
+   right after the call into *REGS. */
+asm (".text\n"
+     "raw_syscall3:\n"
+     "  pushl %ebp\n"
+     "  pushl %ebx\n"
+     "  pushl %esi\n"
+     "  pushl %edi\n"
+     "  movl 40(%esp), %ecx\n"
+     "  movl %esp, 20(%ecx)\n"
+     "  movl 24(%esp), %eax\n"
+     "  movl 28(%esp), %ebx\n"
+     "  movl 32(%esp), %edi\n"
+     "  movl 36(%esp), %esi\n"
+     "  movl $0x1badb002, %ebp\n"
+     "  cmpl $0, 20(%esp)\n"
+     "  je 1f\n"
+     "  movl %esp, %ecx\n"
+     "  movl $2f, %edx\n"
+     "  sysenter\n"
+     "2:\n"
+     "  jmp 3f\n"
+     "1:\n"
+     "  pushl %esi\n"
+     "  pushl %edi\n"
+     "  pushl %ebx\n"
+     "  pushl %eax\n"
+     "  int $0x30\n"
+     "  addl $16, %esp\n"
+     "3:\n"
+     "  movl 40(%esp), %ecx\n"
+     "  movl %eax, 0(%ecx)\n"
+     "  movl %ebx, 4(%ecx)\n"
+     "  movl %esi, 8(%ecx)\n"
+     "  movl %edi, 12(%ecx)\n"
+     "  movl %ebp, 16(%ecx)\n"
+     "  movl %esp, 24(%ecx)\n"
+     "  popl %edi\n"
+     "  popl %esi\n"
+     "  popl %ebx\n"
+     "  popl %ebp\n"
+     "  ret\n");
+
+static void
+check_regs (int fast, int handle, const char *path)
+{
+  static const char buf[] = "sysenter";
+  struct regs r;
+  int size = sizeof buf - 1;
+
+  raw_syscall3 (fast, SYS_WRITE, handle, (int) buf, size, &r);
+  if (r.eax != size)
+    fail ("%s: write returned %d instead of %d", path, r.eax, size);
+  if (r.ebx != handle || r.edi != (int) buf || r.esi != size)
+    fail ("%s: argument registers changed: "
+          "ebx=%#x edi=%#x esi=%#x", path, r.ebx, r.edi, r.esi);
+  if (r.ebp != EBP_MAGIC)
+    fail ("%s: %%ebp changed from %#x to %#x", path, EBP_MAGIC, r.ebp);
+  if (r.esp_before != r.esp_after)
+    fail ("%s: %%esp changed from %#x to %#x",
+          path, r.esp_before, r.esp_after);
+}
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK (create ("regs.txt", 0), "create \"regs.txt\"");
+  CHECK ((handle = open ("regs.txt")) > 1, "open \"regs.txt\"");
+
+  check_regs (0, handle, "int $0x30");
+  if (syscall_sysenter)
+    check_regs (1, handle, "sysenter");
+  msg ("registers preserved");
+
+  CHECK (filesize (handle) == (syscall_sysenter ? 16 : 8),
+         "file size matches");
+  close (handle);
+}
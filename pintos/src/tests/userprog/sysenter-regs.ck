@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sysenter-regs) begin
+(sysenter-regs) create "regs.txt"
+(sysenter-regs) open "regs.txt"
+(sysenter-regs) registers preserved
+(sysenter-regs) file size matches
+(sysenter-regs) end
+sysenter-regs: exit(0)
+EOF
+pass;
@@ -34,6 +34,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -247,6 +248,14 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        cache_size = atoi (value);
+      else if (!strcmp (name, "-cache-flush"))
+        cache_flush_interval = atoi (value);
+      else if (!strcmp (name, "-cache-dirty"))
+        cache_dirty_background = atoi (value);
+      else if (!strcmp (name, "-cache-dirty-max"))
+        cache_dirty_max = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -259,6 +268,10 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-nosysenter"))
+        syscall_sysenter = false;
+      else if (!strcmp (name, "-halt-crash"))
+        syscall_halt_crash = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -373,6 +386,10 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=N           Keep N sectors in the buffer cache.\n"
+          "  -cache-flush=MS    Write back dirty cache sectors every MS ms.\n"
+          "  -cache-dirty=PCT   Start write-back when PCT%% of the cache is dirty.\n"
+          "  -cache-dirty-max=PCT Throttle writers above PCT%% dirty sectors.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -381,6 +398,8 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -nosysenter        Make system calls through int $0x30 only.\n"
+          "  -halt-crash        Make halt power off as if power failed.\n"
 #endif
           );
   shutdown_power_off ();
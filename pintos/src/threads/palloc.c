@@ -30,6 +30,7 @@ struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    size_t cursor;                      /* Where the next search starts. */
     uint8_t *base;                      /* Base of pool. */
   };
 
@@ -61,7 +62,8 @@ palloc_init (size_t user_page_limit)
              user_pages, "user pool");
 }
 
-/* Obtains and returns a group of PAGE_CNT contiguous free pages.
+/* Obtains and returns a group of PAGE_CNT contiguous free pages,
+   searching the pool in next-fit order.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
@@ -78,7 +80,8 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
     return NULL;
 
   lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  page_idx = bitmap_scan_and_flip_next (pool->used_map, &pool->cursor,
+                                        page_cnt, false);
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
@@ -137,8 +140,10 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  lock_acquire (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -166,6 +171,7 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   /* Initialize the pool. */
   lock_init (&p->lock);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->cursor = 0;
   p->base = base + bm_pages * PGSIZE;
 }
 
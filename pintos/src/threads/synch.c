@@ -427,3 +427,136 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK.  A readers-writer lock may be held by any
+   number of readers at once, or by a single writer.
+
+   Waiting writers take precedence over new readers, so a steady
+   stream of readers cannot starve a writer.  The active writer
+   holds RWLOCK's internal WRITE_LOCK for as long as it writes, and
+   every thread that has to wait for it blocks on that lock, so
+   the ordinary priority donation in lock_acquire() raises the
+   writer to the priority of its highest-priority waiter.  Readers
+   cannot receive donations, because there may be many of them. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  lock_init (&rw->write_lock);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writers_ok);
+  rw->readers = 0;
+  rw->waiting_writers = 0;
+  rw->writer = NULL;
+}
+
+/* Waits until the active writer of RW, if any, releases it,
+   donating priority to that writer while waiting.  RW->LOCK must
+   be held on entry and is held again on return, but it is
+   released while waiting. */
+static void
+rwlock_wait_writer (struct rwlock *rw)
+{
+  lock_release (&rw->lock);
+  lock_acquire (&rw->write_lock);
+  lock_release (&rw->write_lock);
+  lock_acquire (&rw->lock);
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it.  The current thread must not already hold
+   RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer != thread_current ());
+  while (rw->writer != NULL || rw->waiting_writers > 0)
+    {
+      if (rw->writer != NULL)
+        rwlock_wait_writer (rw);
+      else
+        cond_wait (&rw->readers_ok, &rw->lock);
+    }
+  rw->readers++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for reading.
+   The last reader out lets a waiting writer in. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0 && rw->waiting_writers > 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until all readers and any
+   other writer have released it.  The current thread must not
+   already hold RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer != thread_current ());
+  rw->waiting_writers++;
+  while (rw->writer != NULL || rw->readers > 0)
+    {
+      if (rw->writer != NULL)
+        rwlock_wait_writer (rw);
+      else
+        cond_wait (&rw->writers_ok, &rw->lock);
+    }
+  rw->waiting_writers--;
+  rw->writer = thread_current ();
+  lock_acquire (&rw->write_lock);
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for writing.
+   Another waiting writer is preferred; otherwise all waiting
+   readers are let in. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer == thread_current ());
+  rw->writer = NULL;
+  lock_release (&rw->write_lock);
+  if (rw->waiting_writers > 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  else
+    cond_broadcast (&rw->readers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
@@ -17,6 +17,7 @@
 #include "filesys/directory.h"
 #ifdef USERPROG
 #include "userprog/process.h"
+#include "userprog/syscall.h"
 #endif
 
 static bool ready_to_schedule;
@@ -35,6 +36,10 @@ static struct list ready_list;
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
+// 已经结束但页面尚未释放的线程
+// thread_schedule_tail在关中断时无法获取页面池的锁，因此由之后的thread_create和thread_exit释放
+static struct list dying_list;
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -151,6 +156,7 @@ void thread_init(void)
   lock_init(&tid_lock);
   list_init(&ready_list);
   list_init(&all_list);
+  list_init(&dying_list);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread();
@@ -228,6 +234,24 @@ void thread_print_stats(void)
          idle_ticks, kernel_ticks, user_ticks);
 }
 
+// 释放dying_list中所有线程的页面，不能在关中断的调度过程中调用
+static void
+free_dying_threads(void)
+{
+  enum intr_level old_level;
+  struct thread *t;
+
+  for (;;)
+  {
+    old_level = intr_disable();
+    t = list_empty(&dying_list) ? NULL : list_entry(list_pop_front(&dying_list), struct thread, elem);
+    intr_set_level(old_level);
+    if (t == NULL)
+      break;
+    palloc_free_page(t);
+  }
+}
+
 /* Creates a new kernel thread named NAME with the given initial
    PRIORITY, which executes FUNCTION passing AUX as the argument,
    and adds it to the ready queue.  Returns the thread identifier
@@ -254,6 +278,8 @@ tid_t thread_create(const char *name, int priority,
 
   ASSERT(function != NULL);
 
+  free_dying_threads();
+
   /* Allocate thread. */
   t = palloc_get_page(PAL_ZERO);
   if (t == NULL)
@@ -382,32 +408,13 @@ void thread_exit(void)
 #ifdef USERPROG
   process_exit();
 #endif
+  free_dying_threads();
   struct thread *current_thread = thread_current();
   struct list_elem *elem_;
+#ifdef USERPROG
   // 关闭该线程所打开的所有文件
-  while (!list_empty(&current_thread->file_list))
-  {
-    elem_ = list_pop_front(&current_thread->file_list);
-    struct file_entry *entry = list_entry(elem_, struct file_entry, elem);
-    lock_acquire(&filesys_lock);
-    // 首先判断file是否为null，如果不为null
-    if (entry->f != NULL)
-    {
-      // 根据file获取该文件的inode
-      struct inode *inode = file_get_inode(entry->f);
-      // 如果该inode为null那么继续下一轮
-      if (inode == NULL)
-        continue;
-      // 如果inode是目录那么通过目录关闭来关闭该file
-      if (inode_is_dir(inode))
-        dir_close(entry->f);
-      else // 如果该inode是文件那么通过文件关闭来关闭该file
-        file_close(entry->f);
-    }
-
-    lock_release(&filesys_lock);
-    free(entry);
-  }
+  syscall_close_all();
+#endif
   // 关闭当前线程的工作目录
   if (thread_current()->dir)
     dir_close(thread_current()->dir);
@@ -657,11 +664,13 @@ init_thread(struct thread *t, const char *name, int priority)
   sema_init(&t->exec_sema, 0);
   t->exec_success = false;
 
-  // 初始化文件管理列表
-  list_init(&t->file_list);
-  t->next_fd = 2;
+  // 文件描述符表在第一次打开文件时分配
+  t->fd_table = NULL;
+  t->fd_map = NULL;
   // 初始化线程的当前目录参数
   t->dir = NULL;
+  t->journal_depth = 0;
+  t->journal_credits = 0;
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -732,7 +741,7 @@ void thread_schedule_tail(struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
   {
     ASSERT(prev != cur);
-    palloc_free_page(prev);
+    list_push_back(&dying_list, &prev->elem);
   }
 }
 
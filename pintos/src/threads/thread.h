@@ -25,7 +25,7 @@ typedef int tid_t;
 #define PRI_DEFAULT 31         /* Default priority. */
 #define PRI_MAX 63             /* Highest priority. */
 #define PRI_DONATE_MAX_DEPTH 8 // 优先级捐献最大深度
-#define FD_MAX 128             // 可创建的文件最大数量
+#define FD_MAX 1024            // 文件描述符的上限，文件描述符表按需增长到该容量
 
 // 子进程的全部信息：不能仅存储子进程本身，而是需要将其中关键的信息也抽取出来
 struct child_entry
@@ -39,12 +39,11 @@ struct child_entry
   struct list_elem elem;
 };
 
-// 某个线程所打开的某个文件的管理结构
+// 某个线程所打开的某个文件的管理结构，dup产生的多个文件描述符共享同一个file_entry
 struct file_entry
 {
-  int fd;         /**< File descriptor. */
   struct file *f; /**< Pointer to file. */
-  struct list_elem elem;
+  int ref_cnt;    // 指向该file_entry的文件描述符数量
 };
 /* A kernel thread or user process.
 
@@ -138,10 +137,12 @@ struct thread
   bool exec_success;          // 判断加载是否成功
 
   struct file *exec_file; // 由线程创建的可执行文件
-  struct list file_list;  // 该线程的可执行文件列表，每一个元素为file_entry
-  int next_fd;            // 下一个被分配的文件描述符
+  struct file_entry **fd_table; // 文件描述符表，以文件描述符为下标，未使用的位置为NULL
+  struct bitmap *fd_map;        // fd_table中已经使用的位置，其大小即fd_table的容量，0和1保留给控制台
 
-  struct dir *dir; // 该线程所处的目录位置
+  struct dir *dir;   // 该线程所处的目录位置
+  int journal_depth;     // 该线程嵌套的元数据日志操作层数
+  size_t journal_credits; // 该线程的日志操作预留而尚未使用的块数
 };
 
 /* If false (default), use round-robin scheduler.
@@ -37,6 +37,13 @@ gdt_init (void)
 {
   uint64_t gdtr_operand;
 
+  /* SYSENTER and SYSEXIT derive the kernel stack selector and
+     both user selectors from SEL_KCSEG, so the segments must
+     stay in this order. */
+  ASSERT (SEL_KDSEG == SEL_KCSEG + 8);
+  ASSERT (SEL_UCSEG == (SEL_KCSEG + 16) + 3);
+  ASSERT (SEL_UDSEG == (SEL_KCSEG + 24) + 3);
+
   /* Initialize GDT. */
   gdt[SEL_NULL / sizeof *gdt] = 0;
   gdt[SEL_KCSEG / sizeof *gdt] = make_code_desc (0);
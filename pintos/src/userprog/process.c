@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -82,18 +83,17 @@ start_process(void *file_name_)
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
 
-  lock_acquire(&filesys_lock);
   success = load(process_name, &if_.eip, &if_.esp);
-  lock_release(&filesys_lock);
 
   if (!success)
   {
     // 如果执行失败就将子进程的状态设置为结束状态同时设置状态码为-1并唤醒父进程
+    // 释放页面要获取页面池的锁，释放锁时会让出CPU，因此先释放页面再唤醒父进程，使退出信息在父进程继续运行前打印
     thread_current()->as_child->is_alive = false;
     thread_current()->exit_code = -1;
-    sema_up(&thread_current()->parent->exec_sema);
     palloc_free_page(fn_for_process_name);
     palloc_free_page(fn_for_start_process_arguments);
+    sema_up(&thread_current()->parent->exec_sema);
     thread_exit();
   } // 如果执行成功就将父进程的执行成功标识符置为true并唤醒父进程
   thread_current()->parent->exec_success = 1;
@@ -127,9 +127,13 @@ start_process(void *file_name_)
     memcpy(if_.esp, &argv[i], ptr_size);
     // printf("%s\n",argv[i]);
   }
+  uintptr_t argv_addr = (uintptr_t)if_.esp;
+  // 压入_start的第三个参数，告诉程序是否通过SYSENTER进行系统调用
+  if_.esp -= ptr_size;
+  *(int *)if_.esp = syscall_sysenter;
   // 第五步：将argv的地址即argv[0]压入栈中，使得程序能够在后续访问到上述参数
   if_.esp -= ptr_size;
-  *(uintptr_t *)if_.esp = ((uintptr_t)if_.esp + ptr_size);
+  *(uintptr_t *)if_.esp = argv_addr;
   // 将argc压入栈中，使得程序能够在后续访问到参数的个数
   if_.esp -= ptr_size;
   *(int *)if_.esp = argc;
@@ -141,10 +145,8 @@ start_process(void *file_name_)
   // hex_dump((uintptr_t)if_.esp, if_.esp, 100, true); // 打印的byte数不用特别准确，随便填大一些
 
   // 一个进程自己正在运行的可执行文件不应该能够被修改于是将自己的可执行文件打开并存入该指针来拒绝写入
-  lock_acquire(&filesys_lock);
   struct file *f = filesys_open(process_name);
   file_deny_write(f);
-  lock_release(&filesys_lock);
   thread_current()->exec_file = f;
 
   palloc_free_page(fn_for_process_name);
@@ -213,9 +215,7 @@ void process_exit(void)
   uint32_t *pd;
   printf("%s: exit(%d)\n", cur->name, cur->exit_code);
   // 关闭当前线程的可执行文件（会自动允许写入）
-  lock_acquire(&filesys_lock);
   file_close(cur->exec_file);
-  lock_release(&filesys_lock);
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -1,15 +1,21 @@
 #include "userprog/syscall.h"
+#include <bitmap.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "string.h"
 #include "threads/vaddr.h"
+#include "devices/shutdown.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
-static void syscall_handler(struct intr_frame *);
+#include "threads/malloc.h"
+#include <syscall-ring.h>
+
+#define FD_TABLE_INIT 16 // 文件描述符表的初始容量
+
 static void syscall_halt(struct intr_frame *) NO_RETURN;
 static void syscall_exit(struct intr_frame *) NO_RETURN;
 static void syscall_exec(struct intr_frame *);
@@ -24,6 +30,10 @@ static void syscall_write(struct intr_frame *);
 static void syscall_seek(struct intr_frame *);
 static void syscall_tell(struct intr_frame *);
 static void syscall_close(struct intr_frame *);
+static void syscall_dup(struct intr_frame *);
+static void syscall_dup2(struct intr_frame *);
+static void syscall_ring_enter(struct intr_frame *);
+static void syscall_dispatch(int syscall_type, struct intr_frame *f);
 
 bool syscall_chdir(struct intr_frame *f);
 bool syscall_mkdir(struct intr_frame *f);
@@ -37,11 +47,29 @@ static char *check_read_user_str(const char *);
 
 static int get_user(const uint8_t *uaddr);
 static bool put_user(uint8_t *udst, uint8_t byte);
+static bool is_user_range(const void *uaddr, size_t size);
+static bool copy_user(void *dst, const void *src, size_t size);
+static bool copy_from_user(void *kdst, const void *usrc, size_t size);
+static bool copy_to_user(void *udst, const void *ksrc, size_t size);
 
 static void terminate_process(void);
 static struct file_entry *get_file_by_fd(int fd);
-static size_t ptr_size = sizeof(void *);
+static bool fd_table_grow(struct thread *t, size_t fd);
+static int fd_install(int fd, struct file_entry *entry);
+static void fd_close(int fd);
+static uint32_t get_arg(struct intr_frame *f, int i);
+
+// 参数在寄存器中的intr_frame的vec_no，由syscall_fast_entry和syscall_ring_enter构造，用来与int $0x30区分
+#define SYSCALL_FAST_VEC 0x100
+
+// 是否允许用户程序通过SYSENTER进入syscall_fast_entry，内核命令行-nosysenter时为false，处理器不支持时由tss_init清除
+// 内核将这一决定作为_start的第三个参数告诉用户程序，用户程序不再自己判断
+bool syscall_sysenter = true;
 
+// 内核命令行-halt-crash时为true，halt系统调用模拟断电而不正常关闭文件系统，用于测试日志的重放
+bool syscall_halt_crash;
+
+// int $0x30总是可用，syscall_sysenter为true时用户程序通过SYSENTER进入syscall_fast_entry，其MSR由tss_init设置
 void syscall_init(void)
 {
   intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
@@ -49,10 +77,21 @@ void syscall_init(void)
 
 // 在用户的中断处理程序中解析系统调用的符号
 // 根据类型分发给各个具体处理函数逐个实现
+// 通过SYSENTER进入时系统调用号和参数在寄存器中，否则在用户栈中
+void syscall_handler(struct intr_frame *f)
+{
+  int syscall_type;
+  if (f->vec_no == SYSCALL_FAST_VEC)
+    syscall_type = f->eax;
+  else if (!copy_from_user(&syscall_type, f->esp, sizeof syscall_type))
+    terminate_process();
+  syscall_dispatch(syscall_type, f);
+}
+
+// 根据系统调用号调用具体的处理函数，参数和返回值都在f中
 static void
-syscall_handler(struct intr_frame *f UNUSED)
+syscall_dispatch(int syscall_type, struct intr_frame *f)
 {
-  int syscall_type = *(int *)check_read_user_ptr(f->esp, sizeof(int));
   switch (syscall_type)
   {
   case SYS_HALT:
@@ -109,6 +148,15 @@ syscall_handler(struct intr_frame *f UNUSED)
   case SYS_INUMBER:
     syscall_inumber(f);
     break;
+  case SYS_DUP:
+    syscall_dup(f);
+    break;
+  case SYS_DUP2:
+    syscall_dup2(f);
+    break;
+  case SYS_RING_ENTER:
+    syscall_ring_enter(f);
+    break;
   default:
     NOT_REACHED();
     break;
@@ -119,14 +167,17 @@ syscall_handler(struct intr_frame *f UNUSED)
 static void
 syscall_halt(struct intr_frame *f UNUSED)
 {
-  shutdown_power_off();
+  if (syscall_halt_crash)
+    shutdown_crash();
+  else
+    shutdown_power_off();
 }
 
 static void
 syscall_exit(struct intr_frame *f)
 {
   // exit_code在系统调用之后被解析为参数
-  int exit_code = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
+  int exit_code = (int)get_arg(f, 0);
   thread_current()->exit_code = exit_code;
   thread_exit();
 }
@@ -134,7 +185,7 @@ syscall_exit(struct intr_frame *f)
 static void
 syscall_exec(struct intr_frame *f)
 {
-  char *cmd_line = *(char **)check_read_user_ptr(f->esp + ptr_size, ptr_size);
+  char *cmd_line = (char *)get_arg(f, 0);
   check_read_user_str(cmd_line);
   f->eax = process_execute(cmd_line);
 }
@@ -142,7 +193,7 @@ syscall_exec(struct intr_frame *f)
 static void
 syscall_wait(struct intr_frame *f)
 {
-  int pid = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
+  int pid = (int)get_arg(f, 0);
   f->eax = process_wait(pid);
 }
 // 创建一个名为file的新文件，其初始大小为 initial_size个字节。如果成功，则返回true，否则返回false。创建新文件不会打开它：打开新文件是一项单独的操作，需要系统调用“open”。
@@ -150,51 +201,57 @@ syscall_wait(struct intr_frame *f)
 static void
 syscall_create(struct intr_frame *f)
 {
-  char *file_name = *(char **)check_read_user_ptr(f->esp + ptr_size, ptr_size);
+  char *file_name = (char *)get_arg(f, 0);
   check_read_user_str(file_name);
-  unsigned file_size = *(unsigned *)check_read_user_ptr(f->esp + 2 * ptr_size, sizeof(unsigned));
+  unsigned file_size = (unsigned)get_arg(f, 1);
 
-  lock_acquire(&filesys_lock);
   bool res = filesys_create(file_name, file_size, false);
   f->eax = res;
-  lock_release(&filesys_lock);
 }
 // 删除名为file的文件。如果成功，则返回true，否则返回false。不论文件是打开还是关闭，都可以将其删除，并且删除打开的文件不会将其关闭。
 static void
 syscall_remove(struct intr_frame *f)
 {
   // 解析参数获取file
-  char *file_ = *(char **)check_read_user_ptr(f->esp + ptr_size, ptr_size);
+  char *file_ = (char *)get_arg(f, 0);
   check_read_user_str(file_); // 对file进行字符串的访存检查
 
-  lock_acquire(&filesys_lock);
   f->eax = filesys_remove(file_); // 将file文件删除同时将结果返回给eax
-  lock_release(&filesys_lock);
 }
 // 打开名为 file 的文件， 返回一个称为"文件描述符"(fd)的非负整数句柄；如果无法打开文件，则返回-1.
 static void
 syscall_open(struct intr_frame *f)
 {
   // 获取参数“文件名”
-  char *file_name = *(char **)check_read_user_ptr(f->esp + ptr_size, ptr_size);
+  char *file_name = (char *)get_arg(f, 0);
   check_read_user_str(file_name);
   // 根据文件名打开文件
-  lock_acquire(&filesys_lock);
   struct file *opened_file = filesys_open(file_name);
-  lock_release(&filesys_lock);
   // 如果文件不存在则返回
   if (opened_file == NULL)
   {
     f->eax = -1;
     return;
   }
-  // 将该文件添加给当前当前进行管理
-  struct thread *current_thread = thread_current();
+  // 将该文件添加给当前当前进行管理，使用最小的空闲文件描述符
   struct file_entry *entry = malloc(sizeof(struct file_entry));
-  entry->fd = current_thread->next_fd++;
-  entry->f = opened_file;
-  list_push_back(&current_thread->file_list, &entry->elem);
-  f->eax = entry->fd;
+  int fd = -1;
+  if (entry != NULL)
+  {
+    entry->f = opened_file;
+    entry->ref_cnt = 1;
+    fd = fd_install(-1, entry);
+    if (fd == -1)
+      free(entry);
+  }
+  if (fd == -1)
+  {
+    if (inode_is_dir(file_get_inode(opened_file)))
+      dir_close((struct dir *)opened_file);
+    else
+      file_close(opened_file);
+  }
+  f->eax = fd;
 }
 // 返回以fd打开的文件的大小（以字节为单位）
 // 增加判断文件是否是目录
@@ -202,16 +259,15 @@ static void
 syscall_filesize(struct intr_frame *f)
 {
   // 解析参数获得fd
-  int fd = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
+  int fd = (int)get_arg(f, 0);
   // 根据fd获得文件指针
   struct file_entry *entry = get_file_by_fd(fd);
-  if (entry->f == NULL)
+  if (entry == NULL || entry->f == NULL)
   {
     f->eax = -1;
   }
   else
   {
-    lock_acquire(&filesys_lock);
     if (inode_is_dir(file_get_inode(entry->f)))
     {
       f->eax = -1;
@@ -220,7 +276,6 @@ syscall_filesize(struct intr_frame *f)
     {
       f->eax = file_length(entry->f);
     }
-    lock_release(&filesys_lock);
   }
 }
 // 从打开为fd的文件中读取size个字节到buffer中。返回实际读取的字节数（文件末尾为0），如果无法读取文件（由于文件末尾以外的条件），则返回-1。 fd 0使用input_getc()从键盘读取。
@@ -229,9 +284,9 @@ static void
 syscall_read(struct intr_frame *f)
 {
   // 解析参数获得fd、buf和size
-  int fd = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
-  void *buf = *(void **)check_read_user_ptr(f->esp + 2 * ptr_size, ptr_size);
-  unsigned size = *(int *)check_read_user_ptr(f->esp + 3 * ptr_size, sizeof(unsigned));
+  int fd = (int)get_arg(f, 0);
+  void *buf = (void *)get_arg(f, 1);
+  unsigned size = (unsigned)get_arg(f, 2);
   check_write_user_ptr(buf, size); // 对长度为size的buf进行指针校验
   // 如果fd为0那么使用input_gec()从键盘中读取
   if (fd == 0)
@@ -254,8 +309,6 @@ syscall_read(struct intr_frame *f)
   struct file_entry *entry = get_file_by_fd(fd);
   if (entry != NULL)
   {
-    lock_acquire(&filesys_lock);
-
     if (inode_is_dir(file_get_inode(entry->f)))
     {
       f->eax = -1;
@@ -264,7 +317,6 @@ syscall_read(struct intr_frame *f)
     {
       f->eax = file_read(entry->f, buf, size); // 如果entry不为NULL那么将size个字节读入buf同时返回size给eax
     }
-    lock_release(&filesys_lock);
   }
   else
   {
@@ -278,9 +330,9 @@ static void
 syscall_write(struct intr_frame *f)
 {
   // 解析参数获得fd、buf和size
-  int fd = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
-  void *buf = *(void **)check_read_user_ptr(f->esp + 2 * ptr_size, ptr_size);
-  unsigned size = *(int *)check_read_user_ptr(f->esp + 3 * ptr_size, sizeof(unsigned));
+  int fd = (int)get_arg(f, 0);
+  void *buf = (void *)get_arg(f, 1);
+  unsigned size = (unsigned)get_arg(f, 2);
   check_read_user_ptr(buf, size); // 对长度为size的buf进行指针校验
   // 如果fd为0那么意味着向STDIN中写，这是不合理的
   if (fd == 0)
@@ -300,7 +352,6 @@ syscall_write(struct intr_frame *f)
   ;
   if (entry != NULL)
   {
-    lock_acquire(&filesys_lock);
     if (inode_is_dir(file_get_inode(entry->f)))
     {
       f->eax = -1;
@@ -309,7 +360,6 @@ syscall_write(struct intr_frame *f)
     {
       f->eax = file_write(entry->f, buf, size); // 如果entry不为NULL那么将size个字节写入buf并返回size
     }
-    lock_release(&filesys_lock);
   }
   else
   {
@@ -322,20 +372,18 @@ static void
 syscall_seek(struct intr_frame *f)
 {
   // 解析参数获得fd和pos
-  int fd = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
-  unsigned pos = *(int *)check_read_user_ptr(f->esp + 2 * ptr_size, sizeof(unsigned));
+  int fd = (int)get_arg(f, 0);
+  unsigned pos = (unsigned)get_arg(f, 1);
   // 根据fd获得文件指针
   struct file_entry *entry = get_file_by_fd(fd);
   if (entry != NULL)
   {
-    lock_acquire(&filesys_lock);
     // 如果文件指针不为NULL同时file也不为null且file不是目录那么就将fd中要读取或者写入的下一个字节更改为position
     if (entry->f != NULL)
     {
       if (!inode_is_dir(file_get_inode(entry->f)))
         file_seek(entry->f, pos);
     }
-    lock_release(&filesys_lock);
   }
 }
 // 返回打开文件fd中要读取或写入的下一个字节的位置，以从文件开头开始的字节数表示。
@@ -344,12 +392,11 @@ static void
 syscall_tell(struct intr_frame *f)
 {
   // 解析参数获得fd
-  int fd = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
+  int fd = (int)get_arg(f, 0);
   // 根据fd获得文件指针
   struct file_entry *entry = get_file_by_fd(fd);
   if (entry != NULL)
   {
-    lock_acquire(&filesys_lock);
     if (entry->f != NULL)
     {
       if (inode_is_dir(file_get_inode(entry->f)))
@@ -365,7 +412,6 @@ syscall_tell(struct intr_frame *f)
     {
       f->eax = -1;
     }
-    lock_release(&filesys_lock);
   }
   else
   {
@@ -378,40 +424,115 @@ static void
 syscall_close(struct intr_frame *f)
 {
   // 解析参数获得fd
-  int fd = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
+  int fd = (int)get_arg(f, 0);
   // 根据fd获得文件指针
+  if (get_file_by_fd(fd) != NULL)
+    fd_close(fd);
+}
+// 复制文件描述符fd，返回最小的空闲文件描述符，两者共享同一个打开的文件和文件位置，失败时返回-1
+static void
+syscall_dup(struct intr_frame *f)
+{
+  int fd = (int)get_arg(f, 0);
   struct file_entry *entry = get_file_by_fd(fd);
-  if (entry != NULL)
+  f->eax = -1;
+  if (entry == NULL)
+    return;
+  f->eax = fd_install(-1, entry);
+  if ((int)f->eax != -1)
+    entry->ref_cnt++;
+}
+// 将文件描述符oldfd复制到newfd，newfd原来打开的文件先被关闭，返回newfd，失败时返回-1
+static void
+syscall_dup2(struct intr_frame *f)
+{
+  int oldfd = (int)get_arg(f, 0);
+  int newfd = (int)get_arg(f, 1);
+  struct file_entry *entry = get_file_by_fd(oldfd);
+  f->eax = -1;
+  // 0和1是控制台，不能作为目标
+  if (entry == NULL || newfd < 2)
+    return;
+  if (newfd == oldfd)
   {
-    lock_acquire(&filesys_lock);
+    f->eax = newfd;
+    return;
+  }
+  if (get_file_by_fd(newfd) != NULL)
+    fd_close(newfd);
+  f->eax = fd_install(newfd, entry);
+  if ((int)f->eax != -1)
+    entry->ref_cnt++;
+}
+// 依次执行系统调用环中最多to_submit个排队的文件系统调用并写入完成队列，只进入内核一次
+// 完成队列满时提前停止，返回执行的个数；环的地址不合法时与其他系统调用一样终止进程
+static void
+syscall_ring_enter(struct intr_frame *f)
+{
+  struct syscall_ring *ring = (struct syscall_ring *)get_arg(f, 0);
+  unsigned to_submit = (unsigned)get_arg(f, 1);
+  uint32_t sq_head, sq_tail, cq_head, cq_tail;
+  unsigned done;
 
-    file_close(entry->f); // 将fd关闭
-    if (entry->f = NULL)
+  if (!copy_from_user(&sq_head, &ring->sq_head, sizeof sq_head) ||
+      !copy_from_user(&sq_tail, &ring->sq_tail, sizeof sq_tail) ||
+      !copy_from_user(&cq_head, &ring->cq_head, sizeof cq_head) ||
+      !copy_from_user(&cq_tail, &ring->cq_tail, sizeof cq_tail))
+    terminate_process();
+  f->eax = -1;
+  if (sq_tail - sq_head > SYSCALL_RING_SIZE || cq_tail - cq_head > SYSCALL_RING_SIZE)
+    return;
+
+  for (done = 0; done < to_submit && sq_head != sq_tail && cq_tail - cq_head < SYSCALL_RING_SIZE; done++)
+  {
+    struct ring_sqe sqe;
+    struct ring_cqe cqe;
+    struct intr_frame frame;
+
+    if (!copy_from_user(&sqe, &ring->sq[sq_head % SYSCALL_RING_SIZE], sizeof sqe))
+      terminate_process();
+    // 与SYSENTER相同，参数放在寄存器的位置，由get_arg取出
+    frame.vec_no = SYSCALL_FAST_VEC;
+    frame.eax = -1;
+    frame.ebx = sqe.args[0];
+    frame.edi = sqe.args[1];
+    frame.esi = sqe.args[2];
+    switch (sqe.number)
     {
-      // 根据file获取inode
-      struct inode *inode = file_get_inode(entry->f);
-      // 如果inode为null那么进入下一轮循环
-      if (inode == NULL)
-        return;
-      // 如果inode为目录那么以目录形式关闭
-      if (inode_is_dir(inode))
-      {
-        dir_close(entry->f);
-      } // 如果inode为文件那么以文件形式关闭
-      else
-      {
-        file_close(entry->f);
-      }
+    case SYS_CREATE:
+    case SYS_REMOVE:
+    case SYS_OPEN:
+    case SYS_FILESIZE:
+    case SYS_READ:
+    case SYS_WRITE:
+    case SYS_SEEK:
+    case SYS_TELL:
+    case SYS_CLOSE:
+      frame.eax = 0; // seek和close没有返回值，完成时结果为0
+      syscall_dispatch(sqe.number, &frame);
+      break;
+    default: // 其他系统调用不能排队执行
+      break;
     }
-    list_remove(&entry->elem); // 将fd从含有它的列表中移除
-    free(entry);               // 将该入口所占有的空间释放
-    lock_release(&filesys_lock);
+
+    cqe.user_data = sqe.user_data;
+    cqe.result = frame.eax;
+    if (!copy_to_user(&ring->cq[cq_tail % SYSCALL_RING_SIZE], &cqe, sizeof cqe))
+      terminate_process();
+    sq_head++;
+    cq_tail++;
   }
+
+  if (!copy_to_user(&ring->sq_head, &sq_head, sizeof sq_head) ||
+      !copy_to_user(&ring->cq_tail, &cq_tail, sizeof cq_tail))
+    terminate_process();
+  f->eax = done;
 }
 // 根据指定的path来修改当前线程的目录
 bool syscall_chdir(struct intr_frame *f)
 {
-  char *path = *(char **)check_read_user_ptr(f->esp + ptr_size, ptr_size);
+  char *path = (char *)get_arg(f, 0);
+  check_read_user_str(path);
   bool success = filesys_chdir(path);
   f->eax = success;
   return success;
@@ -419,7 +540,8 @@ bool syscall_chdir(struct intr_frame *f)
 // 根据指定的path来创建目录
 bool syscall_mkdir(struct intr_frame *f)
 {
-  char *path = *(char **)check_read_user_ptr(f->esp + ptr_size, ptr_size);
+  char *path = (char *)get_arg(f, 0);
+  check_read_user_str(path);
   bool success = filesys_create(path, 0, true);
   f->eax = success;
   return success;
@@ -428,9 +550,12 @@ bool syscall_mkdir(struct intr_frame *f)
 bool syscall_readdir(struct intr_frame *f)
 {
   f->eax = false;
-  int fd = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
-  char *name = *(char **)check_read_user_ptr(f->esp + 2 * ptr_size, ptr_size);
+  int fd = (int)get_arg(f, 0);
+  char *name = (char *)get_arg(f, 1);
+  char kname[NAME_MAX + 1];
   struct file_entry *entry = get_file_by_fd(fd);
+  if (entry == NULL)
+    return false;
   struct file *file = entry->f;
   if (file == NULL)
     return false;
@@ -440,8 +565,11 @@ bool syscall_readdir(struct intr_frame *f)
   if (!inode_is_dir(inode))
     return false;
   struct dir *dir = (struct dir *)file;
-  if (!dir_readdir(dir, name))
+  if (!dir_readdir(dir, kname))
     return false;
+  // 先读到内核缓冲区中，再复制名称及其结尾的'\0'到用户缓冲区
+  if (!copy_to_user(name, kname, strlen(kname) + 1))
+    terminate_process();
   f->eax = true;
   return true;
 }
@@ -449,8 +577,10 @@ bool syscall_readdir(struct intr_frame *f)
 bool syscall_isdir(struct intr_frame *f)
 {
   f->eax = false;
-  int fd = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
+  int fd = (int)get_arg(f, 0);
   struct file_entry *entry = get_file_by_fd(fd);
+  if (entry == NULL)
+    return false;
   struct file *file = entry->f;
   if (file == NULL)
     return false;
@@ -466,8 +596,10 @@ bool syscall_isdir(struct intr_frame *f)
 int syscall_inumber(struct intr_frame *f)
 {
   f->eax = -1;
-  int fd = *(int *)check_read_user_ptr(f->esp + ptr_size, sizeof(int));
+  int fd = (int)get_arg(f, 0);
   struct file_entry *entry = get_file_by_fd(fd);
+  if (entry == NULL)
+    return -1;
   struct file *file = entry->f;
   if (file == NULL)
     return -1;
@@ -479,6 +611,22 @@ int syscall_inumber(struct intr_frame *f)
   return inumber;
 }
 
+// 获取系统调用的第i个参数（从0开始）
+// 通过SYSENTER进入时依次在ebx、edi、esi中，否则在用户栈中系统调用号之上，从用户栈复制时检查地址
+static uint32_t
+get_arg(struct intr_frame *f, int i)
+{
+  uint32_t arg;
+  if (f->vec_no == SYSCALL_FAST_VEC)
+  {
+    ASSERT(i < 3);
+    return i == 0 ? f->ebx : i == 1 ? f->edi : f->esi;
+  }
+  if (!copy_from_user(&arg, (uint32_t *)f->esp + i + 1, sizeof arg))
+    terminate_process();
+  return arg;
+}
+
 // 从用户虚拟地址空间中读取一个字节的信息，如果成功那么就返回该信息否则返回-1
 static int
 get_user(const uint8_t *uaddr)
@@ -500,17 +648,56 @@ put_user(uint8_t *udst, uint8_t byte)
   return error_code != -1;
 }
 
+// 判断[uaddr, uaddr+size)是否完全位于用户地址空间中，size为0时只检查uaddr
+static bool
+is_user_range(const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t)uaddr;
+  if (size == 0)
+    return is_user_vaddr(uaddr);
+  return start + size > start && is_user_vaddr((const void *)(start + size - 1));
+}
+
+// 在内核和用户地址空间之间复制size个字节，访问用户内存时发生页面错误则返回false
+// 与get_user相同，页面错误处理程序跳转到eax中的地址并将eax置为-1
+static bool
+copy_user(void *dst, const void *src, size_t size)
+{
+  int result;
+  asm volatile("movl $1f, %%eax; cld; rep movsb; movl $0, %%eax; 1:"
+               : "=&a"(result), "+D"(dst), "+S"(src), "+c"(size)
+               :
+               : "memory");
+  return result != -1;
+}
+
+// 从用户地址usrc复制size个字节到内核缓冲区kdst，地址不合法时返回false
+static bool
+copy_from_user(void *kdst, const void *usrc, size_t size)
+{
+  return is_user_range(usrc, size) && copy_user(kdst, usrc, size);
+}
+
+// 从内核缓冲区ksrc复制size个字节到用户地址udst，地址不合法或者不可写时返回false
+static bool
+copy_to_user(void *udst, const void *ksrc, size_t size)
+{
+  return is_user_range(udst, size) && copy_user(udst, ksrc, size);
+}
+
 // 检查一个用户提供的指针是否能够合法读取数据，如果合法就返回该指针否则就调用terminate_process
+// 页面是否映射以页为单位决定，因此每一页只需要探测一个字节
 static void *
 check_read_user_ptr(const void *ptr, size_t size)
 {
-  if (!is_user_vaddr(ptr))
+  const uint8_t *p = ptr, *end = (const uint8_t *)ptr + size;
+  if (!is_user_range(ptr, size))
   {
     terminate_process();
   }
-  for (size_t i = 0; i < size; i++)
-  { // check if every byte is safe to read
-    if (get_user(ptr + i) == -1)
+  for (; p < end; p = (const uint8_t *)pg_round_down(p) + PGSIZE)
+  { // check one byte of every page
+    if (get_user(p) == -1)
     {
       terminate_process();
     }
@@ -519,44 +706,45 @@ check_read_user_ptr(const void *ptr, size_t size)
 }
 
 // 检查一个用户提供的指针是否能够合法写数据，如果合法就返回该指针否则就调用terminate_process
+// 每一页探测一个字节，写回读出的原值，不破坏缓冲区的内容
 static void *
 check_write_user_ptr(void *ptr, size_t size)
 {
-  if (!is_user_vaddr(ptr))
+  uint8_t *p = ptr, *end = (uint8_t *)ptr + size;
+  if (!is_user_range(ptr, size))
   {
     terminate_process();
   }
-  for (size_t i = 0; i < size; i++)
+  for (; p < end; p = (uint8_t *)pg_round_down(p) + PGSIZE)
   {
-    if (!put_user(ptr + i, 0))
-    { // check if every byte is safe to write
+    int c = get_user(p);
+    if (c == -1 || !put_user(p, c))
+    { // check one byte of every page
       terminate_process();
     }
   }
   return ptr;
 }
-// 检查一个用户提供的字符串是否能够合法写数据，如果合法就返回该字符串否则就调用terminate_process
+// 检查一个用户提供的字符串是否能够合法读取，如果合法就返回该字符串否则就调用terminate_process
+// 每进入新的一页时探测一次，页内的字节直接读取
 static char *
 check_read_user_str(const char *str)
 {
-  if (!is_user_vaddr(str))
-  {
-    terminate_process();
-  }
-
-  uint8_t *_str = (uint8_t *)str;
+  const char *p = str;
   while (true)
   {
-    int c = get_user(_str);
-    if (c == -1)
+    const char *page_end = (const char *)pg_round_down(p) + PGSIZE;
+    if (!is_user_vaddr(p) || get_user((const uint8_t *)p) == -1)
     {
       terminate_process();
     }
-    else if (c == '\0')
-    {                     // reached the end of str
-      return (char *)str; // remove const
+    for (; p < page_end; p++)
+    {
+      if (*p == '\0')
+      {                     // reached the end of str
+        return (char *)str; // remove const
+      }
     }
-    ++_str;
   }
   NOT_REACHED();
 }
@@ -570,19 +758,119 @@ terminate_process(void)
 }
 
 // 根据fd来查找当前线程是否管理着文件描述符为fd的文件，如果存在那么返回file_entry*否则就返回NULL
+// 文件描述符直接作为文件描述符表的下标
 static struct file_entry *
 get_file_by_fd(int fd)
 {
   struct thread *current_thread = thread_current();
-  struct list_elem *elem_;
-  for (elem_ = list_begin(&current_thread->file_list); elem_ != list_end(&current_thread->file_list);
-       elem_ = list_next(elem_))
+  if (fd < 0 || current_thread->fd_map == NULL || (size_t)fd >= bitmap_size(current_thread->fd_map))
+    return NULL;
+  return current_thread->fd_table[fd];
+}
+
+// 扩大线程t的文件描述符表使其能够容纳文件描述符fd，容量按倍数增长，超过FD_MAX或内存不足时返回false
+static bool
+fd_table_grow(struct thread *t, size_t fd)
+{
+  size_t cap = t->fd_map != NULL ? bitmap_size(t->fd_map) : 0;
+  size_t new_cap, i;
+  struct file_entry **table;
+  struct bitmap *map;
+
+  if (fd < cap)
+    return true;
+  if (fd >= FD_MAX)
+    return false;
+  new_cap = cap == 0 ? FD_TABLE_INIT : cap * 2;
+  while (new_cap <= fd)
+    new_cap *= 2;
+  if (new_cap > FD_MAX)
+    new_cap = FD_MAX;
+
+  // 表的容量由fd_map决定，fd_map创建失败时变大的fd_table不会被使用
+  table = realloc(t->fd_table, new_cap * sizeof *table);
+  if (table == NULL)
+    return false;
+  t->fd_table = table;
+  map = bitmap_create(new_cap);
+  if (map == NULL)
+    return false;
+  for (i = cap; i < new_cap; i++)
+    table[i] = NULL;
+  if (t->fd_map == NULL)
+    bitmap_set_multiple(map, 0, 2, true); // 0和1是控制台
+  else
   {
-    struct file_entry *entry = list_entry(elem_, struct file_entry, elem);
-    if (entry->fd == fd)
+    for (i = 0; i < cap; i++)
+      bitmap_set(map, i, bitmap_test(t->fd_map, i));
+    bitmap_destroy(t->fd_map);
+  }
+  t->fd_map = map;
+  return true;
+}
+
+// 将entry放入当前线程的文件描述符表，fd为-1时使用最小的空闲文件描述符，否则使用空闲的fd
+// 返回使用的文件描述符，表无法扩大时返回-1，不修改entry的引用计数
+static int
+fd_install(int fd, struct file_entry *entry)
+{
+  struct thread *t = thread_current();
+  size_t idx;
+
+  if (fd == -1)
+  {
+    idx = t->fd_map != NULL ? bitmap_scan(t->fd_map, 0, 1, false) : BITMAP_ERROR;
+    if (idx == BITMAP_ERROR)
     {
-      return entry;
+      idx = t->fd_map != NULL ? bitmap_size(t->fd_map) : 2;
+      if (!fd_table_grow(t, idx))
+        return -1;
     }
   }
-  return NULL;
+  else
+  {
+    idx = fd;
+    if (!fd_table_grow(t, idx))
+      return -1;
+    ASSERT(!bitmap_test(t->fd_map, idx));
+  }
+  bitmap_mark(t->fd_map, idx);
+  t->fd_table[idx] = entry;
+  return idx;
+}
+
+// 释放当前线程的文件描述符fd，最后一个指向该文件的文件描述符被释放时关闭文件
+static void
+fd_close(int fd)
+{
+  struct thread *t = thread_current();
+  struct file_entry *entry = t->fd_table[fd];
+
+  t->fd_table[fd] = NULL;
+  bitmap_reset(t->fd_map, fd);
+  if (--entry->ref_cnt > 0)
+    return;
+  // 如果inode为目录那么以目录形式关闭，否则以文件形式关闭
+  if (inode_is_dir(file_get_inode(entry->f)))
+    dir_close((struct dir *)entry->f);
+  else
+    file_close(entry->f);
+  free(entry);
+}
+
+// 关闭当前线程的所有文件描述符并释放文件描述符表，在线程退出时调用
+void syscall_close_all(void)
+{
+  struct thread *t = thread_current();
+  size_t fd;
+
+  if (t->fd_map == NULL)
+    return;
+  for (fd = 2; fd < bitmap_size(t->fd_map); fd++)
+    if (t->fd_table[fd] != NULL)
+      fd_close(fd);
+  free(t->fd_table);
+  bitmap_destroy(t->fd_map);
+  t->fd_table = NULL;
+  t->fd_map = NULL;
 }
@@ -1,6 +1,16 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+
+struct intr_frame;
+
+extern bool syscall_sysenter;
+extern bool syscall_halt_crash;
+
 void syscall_init (void);
+void syscall_handler (struct intr_frame *);
+void syscall_fast_entry (void);
+void syscall_close_all (void);
 
 #endif /* userprog/syscall.h */
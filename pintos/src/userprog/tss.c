@@ -1,7 +1,9 @@
 #include "userprog/tss.h"
 #include <debug.h>
 #include <stddef.h>
+#include <sysenter.h>
 #include "userprog/gdt.h"
+#include "userprog/syscall.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -75,6 +77,18 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* Model-specific registers read by SYSENTER. */
+#define MSR_SYSENTER_CS 0x174   /* Kernel code selector. */
+#define MSR_SYSENTER_ESP 0x175  /* Kernel stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /* Entry point. */
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint32_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -86,6 +100,21 @@ tss_init (void)
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update ();
+
+  /* SYSENTER does not consult the TSS, so point its stack pointer
+     at esp0, which syscall_fast_entry loads as the real kernel
+     stack.  tss_update() keeps esp0 current, so the MSRs never
+     need to change after this.  User programs learn whether to
+     use SYSENTER from syscall_sysenter, which -nosysenter may
+     already have cleared. */
+  if (!sysenter_supported ())
+    syscall_sysenter = false;
+  if (syscall_sysenter)
+    {
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_ESP, (uint32_t) &tss->esp0);
+      wrmsr (MSR_SYSENTER_EIP, (uint32_t) syscall_fast_entry);
+    }
 }
 
 /* Returns the kernel TSS. */